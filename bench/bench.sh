@@ -0,0 +1,135 @@
+# Measures the end-to-end cost of launching a trivial program through elvee
+# in its various modes, against launching the program directly and through a
+# shell script doing the equivalent, for search directories of various sizes.
+# The following environment variables tune a run:
+#
+#   CC      compiler to build with (default: clang)
+#   ELVEE   path of an elvee binary to use instead of building one
+#   RUNS    launches measured per mode and size (default: 1000)
+#   SIZES   numbers of version directories per search directory
+#           (default: 1 100 10000 100000)
+#   SYSCALL_BUDGET
+#           syscalls that a plain launch may make at most (default: 220),
+#           or 0 to skip that check
+#
+# Each search directory also gets as many non-version directories and as many
+# files named like versions as noise. Latencies are in microseconds. The
+# mean number of minor page faults per launch is reported too, as well as the
+# number of syscalls per launch if strace is available, in which case the run
+# fails at the end if a plain launch (spawning a trivial target and waiting
+# for it, through a search directory with a single version) goes over the
+# syscall budget. The count includes the syscalls of the target itself.
+
+cd "$(dirname "$0")"
+set -e
+
+CC=${CC:-clang}
+RUNS=${RUNS:-1000}
+SIZES=${SIZES:-"1 100 10000 100000"}
+SYSCALL_BUDGET=${SYSCALL_BUDGET:-220}
+
+work=$(mktemp -d)
+daemon_pid=
+trap '[ -n "$daemon_pid" ] && kill $daemon_pid 2>/dev/null; rm -rf "$work"' EXIT
+
+$CC -O2 -o "$work/launch" launch.c
+if [ -n "$ELVEE" ]; then
+    cp "$ELVEE" "$work/elvee"
+else
+    $CC -O2 -pthread -o "$work/elvee" ../elvee.c ../libelvee.c
+fi
+echo 'int main(void) { return 0; }' | $CC -O2 -x c -o "$work/true" -
+
+# Builds a search directory with a given number of versions at a given path.
+# The latest version is v2.0.0 and its target program, "run", does nothing
+# but exit. The search directory gets a shim for it too as well as "run.sh",
+# which finds and runs the latest version like the shim but in shell.
+
+make_root() {
+    mkdir -p "$1"
+    (
+        cd "$1"
+        seq -f 'v1.%g.0'        1 "$2" | xargs mkdir
+        seq -f 'build-%g'       1 "$2" | xargs mkdir
+        seq -f 'v1.%g.0.tar.gz' 1 "$2" | xargs touch
+        mkdir v2.0.0
+        cp "$work/true" v2.0.0/run
+        cp "$work/elvee" run
+        cat > run.sh <<'SH'
+#!/bin/sh
+root=$(dirname "$0")
+exec "$(find "$root" -mindepth 1 -maxdepth 1 -type d -name 'v*' | sort -V | tail -n 1)/run" "$@"
+SH
+        chmod +x run.sh
+    )
+}
+
+# Measures launching a program under a mode name, with the variables listed
+# in "vars" added to the environment.
+
+measure() {
+    syscalls=-
+    if command -v strace > /dev/null; then
+        syscalls=$(env $vars strace -f -c -o /dev/stdout "$2" | awk '$NF == "total" { print $4 }')
+    fi
+    printf '%8s  %-14s %8s %8s %8s %8s %7s %9s\n' "$size" "$1" $(env $vars "$work/launch" "$RUNS" "$2") "$syscalls"
+}
+
+printf '%8s  %-14s %8s %8s %8s %8s %7s %9s\n' size mode p50 p99 p999 mean faults syscalls
+
+for size in $SIZES; do
+    make_root "$work/root-$size" "$size"
+done
+
+# Let the time stamps of the search directories settle so that they qualify
+# for the resolution cache.
+
+sleep 2
+
+for size in $SIZES; do
+    root="$work/root-$size"
+
+    vars=
+    measure direct "$root/v2.0.0/run"
+    measure shell "$root/run.sh"
+
+    vars=ELVEE_SPAWN=posix_spawn
+    measure posix_spawn "$root/run"
+
+    vars=ELVEE_SPAWN=fork
+    measure fork "$root/run"
+
+    vars=ELVEE_EXEC=1
+    measure exec "$root/run"
+
+    vars="ELVEE_EXEC=1 ELVEE_CACHE=1 XDG_CACHE_HOME=$work/cache"
+    measure exec+cache "$root/run"
+
+    ELVEE_INDEX="$work/index" "$work/elvee" daemon "$work/daemon.sock" &
+    daemon_pid=$!
+    sleep 1
+
+    vars="ELVEE_EXEC=1 ELVEE_DAEMON=$work/daemon.sock"
+    measure exec+daemon "$root/run"
+
+    vars="ELVEE_EXEC=1 ELVEE_DAEMON=$work/daemon.sock ELVEE_INDEX=$work/index"
+    measure exec+index "$root/run"
+
+    kill $daemon_pid
+    wait $daemon_pid 2>/dev/null || true
+    daemon_pid=
+
+    "$work/elvee" promote "$root" > /dev/null
+    vars=ELVEE_EXEC=1
+    measure exec+promote "$root/run"
+    rm "$root/current"
+done
+
+if [ "$SYSCALL_BUDGET" != 0 ] && command -v strace > /dev/null; then
+    make_root "$work/root-budget" 1
+    syscalls=$(strace -f -c -o /dev/stdout "$work/root-budget/run" | awk '$NF == "total" { print $4 }')
+    if [ "$syscalls" -gt "$SYSCALL_BUDGET" ]; then
+        echo "A plain launch made $syscalls syscalls, over the budget of $SYSCALL_BUDGET." >&2
+        exit 1
+    fi
+fi
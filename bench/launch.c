@@ -0,0 +1,132 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Launches a program a number of times, one after the other, and reports the
+// distribution of the time taken by each launch, from spawning it to reaping
+// it, in microseconds, and the mean number of minor page faults incurred by
+// the launched process (and any process it waited for):
+//
+//     launch COUNT PROGRAM [ ARG... ]
+//
+// The output is a single line of space-separated fields:
+//
+//     P50 P99 P999 MEAN FAULTS
+//
+// The standard output of the launched program is discarded so as not to mix
+// with the results. Exits with a non-zero code if any launch fails or exits
+// with a non-zero code itself.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define WARMUP_COUNT 10
+
+int compare_longs(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+long elapsed_usec(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000L + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: launch COUNT PROGRAM [ ARG... ]\n");
+        return 1;
+    }
+
+    int count = atoi(argv[1]);
+    if (count <= 0) {
+        fprintf(stderr, "Invalid count: %s\n", argv[1]);
+        return 1;
+    }
+
+    long *samples = malloc(count * sizeof(samples[0]));
+    if (!samples) {
+        fprintf(stderr, "Out of memory!\n");
+        return 1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+    long faults = 0;
+
+    for (int i = -WARMUP_COUNT; i < count; i++) {
+        struct timespec start, end;
+        struct rusage usage;
+        pid_t pid;
+        int status;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int err = posix_spawn(&pid, argv[2], &actions, NULL, argv + 2, environ);
+        if (err) {
+            fprintf(stderr, "Error launching: %s\nReason: %s\n", argv[2], strerror(err));
+            return 1;
+        }
+        if (wait4(pid, &status, 0, &usage) < 0) {
+            fprintf(stderr, "Error waiting: %s\nReason: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            fprintf(stderr, "Launch failed: %s\n", argv[2]);
+            return 1;
+        }
+
+        if (i >= 0) {
+            samples[i] = elapsed_usec(&start, &end);
+            faults += usage.ru_minflt;
+        }
+    }
+
+    qsort(samples, count, sizeof(samples[0]), compare_longs);
+
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+
+    printf("%ld %ld %ld %.0f %.0f\n",
+           samples[count * 50 / 100],
+           samples[count * 99 / 100],
+           samples[count * 999 / 1000],
+           sum / count,
+           (double)faults / count);
+
+    free(samples);
+    return 0;
+}
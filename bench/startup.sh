@@ -0,0 +1,35 @@
+# Builds elvee in each flavor supported by build.sh and reports, for each,
+# the binary size in bytes as well as the latency (in microseconds) and the
+# mean number of minor page faults of launching it to do next to nothing
+# (print its build time stamp), which approximates the cost of getting from
+# exec to main and back out. Flavors that fail to build (such as "static"
+# without musl-gcc) are reported as such. The following environment
+# variables tune a run:
+#
+#   CC        compiler to build with (default: clang)
+#   RUNS      launches measured per flavor (default: 1000)
+#   FLAVORS   flavors to build (default: default release lto min static pgo)
+
+cd "$(dirname "$0")"
+set -e
+
+RUNS=${RUNS:-1000}
+FLAVORS=${FLAVORS:-"default release lto min static pgo"}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+${CC:-clang} -O2 -o "$work/launch" launch.c
+
+printf '%-8s %9s %8s %8s %8s %8s %7s\n' flavor size p50 p99 p999 mean faults
+
+for flavor in $FLAVORS; do
+    mkdir "$work/$flavor"
+    if ! OUT="$work/$flavor/elvee" sh ../build.sh "$flavor" > "$work/$flavor/build.log" 2>&1; then
+        printf '%-8s (failed to build)\n' "$flavor"
+        continue
+    fi
+    printf '%-8s %9s %8s %8s %8s %8s %7s\n' "$flavor" \
+        $(wc -c < "$work/$flavor/elvee") \
+        $("$work/launch" "$RUNS" "$work/$flavor/elvee" timestamp)
+done
@@ -0,0 +1,413 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Stresses the resolution of the latest version while versions are being
+// deployed and retired in the same search directory:
+//
+//     stress ELVEE ROOT [ SECONDS [ WORKERS ] ]
+//
+// ELVEE is the path of the shim binary and ROOT the path of an empty
+// directory to use as the search directory. For SECONDS (default 10), a
+// deployer thread keeps adding versions to ROOT, alternating between writing
+// them in place and staging them under a temporary name that's then renamed
+// into place. Every fifth version is rolled back right after being deployed,
+// and old versions are removed to keep only a few around. Meanwhile, WORKERS
+// threads (default 64) keep launching a probe program through a copy of the
+// shim in ROOT. The probe reports whether the version it was launched from
+// was completely deployed. At the end, the throughput, the latency
+// distribution (in microseconds) and the count of launches per outcome are
+// reported:
+//
+//   ok            launched from a completely deployed version
+//   incomplete    launched from a version whose deployment was in progress
+//   half-written  resolved to a version whose program was still being written
+//                 (ETXTBSY or ENOEXEC, or the program crashed)
+//   gone          resolved to a version that was already removed (ENOENT) or
+//                 found no version at all
+//   failed        failed for any other reason
+//
+// Each launch that doesn't run is also logged to STDERR with its outcome, the
+// path that the shim resolved and the reason the shim gave.
+//
+// The environment is passed on to the shim so ELVEE_* variables can be set to
+// stress its various modes.
+
+#define _GNU_SOURCE // for pipe2
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+#define DIM(x) (sizeof(x) / sizeof((x)[0]))
+
+#define PROBE_ENV        "STRESS_PROBE"
+#define COMPLETE_NAME    "COMPLETE"
+#define KEEP_VERSIONS    3
+#define ROLLBACK_EVERY   5
+#define CHUNK_SIZE       4096
+#define WORKER_SAMPLES   (1 << 14) // latencies kept per worker
+
+enum outcome { OK, INCOMPLETE, HALF_WRITTEN, GONE, FAILED, OUTCOMES };
+
+char *outcome_names[] = { "ok", "incomplete", "half-written", "gone", "failed" };
+
+struct worker {
+    pthread_t thread;
+    long counts[OUTCOMES];
+    long *samples;
+    long sample_count;
+};
+
+char *root;
+char shim_path[4096];
+char *probe_image;
+size_t probe_size;
+volatile int stop;
+long deploys, rollbacks;
+
+long now_usec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+int compare_longs(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Runs as the probe: reports the path it was launched as and whether the
+// version directory it was launched from was completely deployed.
+
+int probe(char *self)
+{
+    char marker[4096];
+    char *sep = strrchr(self, '/');
+    snprintf(marker, DIM(marker), "%.*s/" COMPLETE_NAME, sep ? (int)(sep - self) : 1, sep ? self : ".");
+    printf("%d %s\n", 0 == access(marker, F_OK), self);
+    return 0;
+}
+
+int read_file(char *path, char **data, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 1;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    *data = malloc(*size);
+    int failed = !*data || fread(*data, 1, *size, f) != *size;
+    fclose(f);
+    return failed;
+}
+
+// Writes a version directory in "dir" the way a naive deployment would: the
+// probe gets copied a chunk at a time and the completion marker goes last.
+
+void write_version(char *dir)
+{
+    char path[4096];
+    mkdir(dir, 0755);
+
+    snprintf(path, DIM(path), "%s/run", dir);
+    // Descriptors are opened close-on-exec throughout so that launches by
+    // the workers don't inherit them (which would make a version being
+    // written busy and keep the pipes of other workers open).
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    for (size_t offset = 0; fd >= 0 && offset < probe_size; offset += CHUNK_SIZE) {
+        size_t size = probe_size - offset < CHUNK_SIZE ? probe_size - offset : CHUNK_SIZE;
+        if (write(fd, probe_image + offset, size) < 0)
+            break;
+        usleep(100);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    snprintf(path, DIM(path), "%s/" COMPLETE_NAME, dir);
+    close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+}
+
+void remove_version(char *dir)
+{
+    char path[4096];
+    snprintf(path, DIM(path), "%s/" COMPLETE_NAME, dir);
+    unlink(path);
+    snprintf(path, DIM(path), "%s/run", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+void *deployer(void *arg)
+{
+    char dir[4096], staging[4096], retired[4096];
+    for (int n = 1; !stop; n++) {
+        snprintf(dir, DIM(dir), "%s/v1.%d.0", root, n);
+        if (n % 2) {
+            write_version(dir);
+        }
+        else {
+            snprintf(staging, DIM(staging), "%s/.staging-%d", root, n);
+            write_version(staging);
+            rename(staging, dir);
+        }
+        deploys++;
+
+        if (n % ROLLBACK_EVERY == 0) {
+            snprintf(retired, DIM(retired), "%s/.retired-%d", root, n);
+            rename(dir, retired);
+            remove_version(retired);
+            rollbacks++;
+        }
+
+        if (n > KEEP_VERSIONS) {
+            snprintf(dir, DIM(dir), "%s/v1.%d.0", root, n - KEEP_VERSIONS);
+            remove_version(dir);
+        }
+    }
+    return NULL;
+}
+
+// Reads "fd" into "buf" of "size" characters, up to the end of the stream or
+// of the buffer, and closes it. The buffer is always null-terminated.
+
+void read_all(int fd, char *buf, size_t size)
+{
+    size_t len = 0;
+    ssize_t n;
+    while (len < size - 1 && (n = read(fd, buf + len, size - 1 - len)) > 0) {
+        len += n;
+    }
+    buf[len] = 0;
+    close(fd);
+}
+
+// Copies the rest of the line that follows "label" in "text" to "buf" of
+// "size" characters, or "?" if "label" isn't found.
+
+void find_field(char *text, char *label, char *buf, size_t size)
+{
+    char *p = strstr(text, label);
+    if (!p) {
+        snprintf(buf, size, "?");
+        return;
+    }
+    p += strlen(label);
+    snprintf(buf, size, "%.*s", (int)strcspn(p, "\n"), p);
+}
+
+// Classifies a launch that didn't run by the error that the shim reported
+// on "errors" (or the "status" of the target) and logs it.
+
+enum outcome classify_failure(char *errors, int status)
+{
+    char path[4096], reason[4096];
+    enum outcome outcome;
+
+    find_field(errors, "Error launching: ", path, DIM(path));
+    find_field(errors, "Reason: ", reason, DIM(reason));
+
+    if (strstr(errors, "No version found")) {
+        outcome = GONE;
+        snprintf(reason, DIM(reason), "no version found");
+    }
+    else if (!strcmp(reason, strerror(ENOENT))) {
+        outcome = GONE;
+    }
+    else if (!strcmp(reason, strerror(ETXTBSY)) || !strcmp(reason, strerror(ENOEXEC))) {
+        outcome = HALF_WRITTEN;
+    }
+    else if (WIFSIGNALED(status)) {
+        outcome = HALF_WRITTEN;
+        snprintf(reason, DIM(reason), "killed by signal %d", WTERMSIG(status));
+    }
+    else {
+        outcome = FAILED;
+        if (!strcmp(reason, "?")) {
+            snprintf(reason, DIM(reason), "%.*s", (int)strcspn(errors, "\n"), *errors ? errors : "no output");
+        }
+    }
+
+    fprintf(stderr, "%s: %s (%s)\n", outcome_names[outcome], path, reason);
+    return outcome;
+}
+
+// Launches the probe through the shim once and classifies the outcome.
+
+enum outcome launch()
+{
+    int out[2], err[2];
+    if (pipe2(out, O_CLOEXEC))
+        return FAILED;
+    if (pipe2(err, O_CLOEXEC)) {
+        close(out[0]);
+        close(out[1]);
+        return FAILED;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+    char *argv[] = { shim_path, NULL };
+    pid_t pid;
+    int error = posix_spawn(&pid, shim_path, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out[1]);
+    close(err[1]);
+
+    // The probe writes a single short line and the shim a few short lines
+    // of errors at most, so reading one pipe after the other can't block.
+
+    char output[4096], errors[4096];
+    read_all(out[0], output, DIM(output));
+    read_all(err[0], errors, DIM(errors));
+
+    int status = 0;
+    if (error) {
+        fprintf(stderr, "failed: %s (%s)\n", shim_path, strerror(error));
+        return FAILED;
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        fprintf(stderr, "failed: %s (%s)\n", shim_path, strerror(errno));
+        return FAILED;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) || !*output) {
+        return classify_failure(errors, status);
+    }
+
+    return output[0] == '1' ? OK : INCOMPLETE;
+}
+
+void *worker(void *arg)
+{
+    struct worker *w = arg;
+    while (!stop) {
+        long start = now_usec();
+        w->counts[launch()]++;
+        if (w->sample_count < WORKER_SAMPLES) {
+            w->samples[w->sample_count++] = now_usec() - start;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if (getenv(PROBE_ENV)) {
+        return probe(argv[0]);
+    }
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: stress ELVEE ROOT [ SECONDS [ WORKERS ] ]\n");
+        return 1;
+    }
+
+    root = argv[2];
+    int seconds = argc > 3 ? atoi(argv[3]) : 10;
+    int worker_count = argc > 4 ? atoi(argv[4]) : 64;
+
+    // The probe is this very program, told apart by an environment variable.
+
+    char *shim_image;
+    size_t shim_size;
+    if (read_file(argv[0], &probe_image, &probe_size) || read_file(argv[1], &shim_image, &shim_size)) {
+        fprintf(stderr, "Error reading: %s or %s\nReason: %s\n", argv[0], argv[1], strerror(errno));
+        return 1;
+    }
+
+    snprintf(shim_path, DIM(shim_path), "%s/run", root);
+    int fd = open(shim_path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (fd < 0 || write(fd, shim_image, shim_size) != shim_size) {
+        fprintf(stderr, "Error writing: %s\nReason: %s\n", shim_path, strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    // Make sure there's always at least one version to run.
+
+    char dir[4096];
+    snprintf(dir, DIM(dir), "%s/v1.0.0", root);
+    write_version(dir);
+
+    setenv(PROBE_ENV, "1", 1);
+
+    struct worker *workers = calloc(worker_count, sizeof(workers[0]));
+    pthread_t deployer_thread;
+    pthread_create(&deployer_thread, NULL, deployer, NULL);
+    for (int i = 0; i < worker_count; i++) {
+        workers[i].samples = malloc(WORKER_SAMPLES * sizeof(long));
+        pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+    }
+
+    sleep(seconds);
+    stop = 1;
+
+    pthread_join(deployer_thread, NULL);
+
+    long counts[OUTCOMES] = { 0 };
+    long *samples = malloc((size_t)worker_count * WORKER_SAMPLES * sizeof(long));
+    long sample_count = 0;
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (int j = 0; j < OUTCOMES; j++) {
+            counts[j] += workers[i].counts[j];
+        }
+        memcpy(samples + sample_count, workers[i].samples, workers[i].sample_count * sizeof(long));
+        sample_count += workers[i].sample_count;
+    }
+
+    long total = 0;
+    for (int i = 0; i < OUTCOMES; i++) {
+        total += counts[i];
+    }
+    printf("launches: %ld (%.0f/s)\n", total, (double)total / seconds);
+    printf("deploys: %ld (%ld rolled back)\n", deploys, rollbacks);
+
+    if (sample_count) {
+        qsort(samples, sample_count, sizeof(long), compare_longs);
+        printf("latency: p50=%ld p99=%ld p999=%ld\n",
+               samples[sample_count * 50 / 100],
+               samples[sample_count * 99 / 100],
+               samples[sample_count * 999 / 1000]);
+    }
+
+    for (int i = 0; i < OUTCOMES; i++) {
+        printf("%s: %ld\n", outcome_names[i], counts[i]);
+    }
+
+    return 0;
+}
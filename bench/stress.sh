@@ -0,0 +1,18 @@
+# Builds the shim and the stress tool (see stress.c) and runs the latter in a
+# fresh search directory. Any arguments (SECONDS and WORKERS) are passed on to
+# the stress tool and the environment variable CC selects the compiler
+# (default: clang).
+
+cd "$(dirname "$0")"
+set -e
+
+CC=${CC:-clang}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+$CC -O2 -pthread -o "$work/elvee" ../elvee.c ../libelvee.c
+$CC -O2 -pthread -o "$work/stress" stress.c
+
+mkdir "$work/root"
+"$work/stress" "$work/elvee" "$work/root" "$@"
@@ -0,0 +1,296 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that elvee_parse_version and elvee_version_gt pick the same latest
+// version as the sscanf-based parsing that they replaced, then measures both:
+//
+//     versions CORPUS [ BATCHES ]
+//
+// CORPUS is a file with a directory name per line (blank lines and lines
+// starting with # are skipped). Every ordered pair of names in it is compared
+// both ways, then BATCHES (default 100000) random batches of generated names
+// are each reduced to their latest version both ways. Any disagreement is
+// printed and makes the exit status non-zero. Finally, the time per name (in
+// nanoseconds) of picking the latest out of a large batch is reported for
+// both.
+//
+// Names that fall outside the documented grammar and on which the two are
+// known to differ are neither expected in the corpus nor generated:
+//
+//   - sscanf's %u accepts leading whitespace and a sign (v-1, v 1 or v+1)
+//   - components beyond UINT_MAX saturate rather than wrap around
+//   - sscanf's %s stops the suffix at whitespace
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../libelvee.h"
+
+#define DIM(x) (sizeof(x) / sizeof((x)[0]))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define BATCH_SIZE   16
+#define BENCH_NAMES  100000
+#define BENCH_RUNS   20
+
+// The latest version picked so far out of a batch, the old way.
+
+struct old_latest {
+    char name[ELVEE_VERSION_NAME_SIZE];
+    char suffix[ELVEE_VERSION_NAME_SIZE];
+    unsigned int major, minor, patch;
+};
+
+// The latest version picked so far out of a batch, the new way.
+
+struct new_latest {
+    char name[ELVEE_VERSION_NAME_SIZE];
+    struct elvee_version version;
+};
+
+// Considers "name" for the latest version the way find_latest_version did
+// before elvee_parse_version, returning 1 if it was an upgrade.
+
+int old_consider(struct old_latest *l, const char *name)
+{
+    unsigned int major = 0, minor = 0, patch = 0;
+    char suffix[ELVEE_VERSION_NAME_SIZE] = { 0 };
+    int tokens;
+    if ((tokens = sscanf(name, "v%u.%u.%u%s", &major, &minor, &patch, suffix)) < 3) {
+        if ((tokens = sscanf(name, "v%u.%u%s", &major, &minor, suffix)) < 2) {
+            tokens = sscanf(name, "v%u%s", &major, suffix);
+        }
+    }
+
+    if (tokens <= 0)
+        return 0;
+
+    if (*suffix && *suffix != '-')
+        return 0;
+
+    int upgrade
+        =   major > l->major
+        || (major == l->major && minor > l->minor)
+        || (major == l->major && minor == l->minor && patch > l->patch)
+        || (major == l->major && minor == l->minor && patch == l->patch
+            && *suffix && *l->suffix
+            && strncmp(suffix, l->suffix, min(1 + strlen(suffix), 1 + strlen(l->suffix))) > 0);
+
+    if (upgrade) {
+        l->major = major;
+        l->minor = minor;
+        l->patch = patch;
+        strcpy(l->suffix, suffix);
+        strcpy(l->name, name);
+    }
+
+    return upgrade;
+}
+
+// Considers "name" for the latest version the way find_latest_version does
+// now, returning 1 if it was an upgrade.
+
+int new_consider(struct new_latest *l, const char *name)
+{
+    struct elvee_version version;
+    if (!elvee_parse_version(name, &version))
+        return 0;
+
+    if (*version.suffix && *version.suffix != '-')
+        return 0;
+
+    int upgrade = elvee_version_gt(&version, &l->version);
+    if (upgrade) {
+        strcpy(l->name, name);
+        l->version = version;
+        l->version.suffix = l->name + (version.suffix - name);
+    }
+
+    return upgrade;
+}
+
+void old_reset(struct old_latest *l)
+{
+    memset(l, 0, sizeof(*l));
+}
+
+void new_reset(struct new_latest *l)
+{
+    *l->name = 0;
+    l->version = (struct elvee_version){ 0, 0, 0, l->name };
+}
+
+// Picks the latest of "count" names both ways and reports any difference.
+// Returns 0 if both agree or 1 otherwise.
+
+int check_batch(char **names, int count)
+{
+    struct old_latest old;
+    struct new_latest new;
+    old_reset(&old);
+    new_reset(&new);
+
+    for (int i = 0; i < count; i++) {
+        old_consider(&old, names[i]);
+        new_consider(&new, names[i]);
+    }
+
+    if (!strcmp(old.name, new.name))
+        return 0;
+
+    printf("Mismatch: old picked \"%s\" but new picked \"%s\" out of:\n", old.name, new.name);
+    for (int i = 0; i < count; i++) {
+        printf("  %s\n", names[i]);
+    }
+    return 1;
+}
+
+// Generates a random name that's mostly, but not always, within the grammar
+// of version directory names. Components are drawn from a few values so that
+// ties, and so suffix comparisons, are frequent.
+
+void generate_name(char *buf, size_t size)
+{
+    static const char *numbers[] = { "0", "1", "2", "10", "01", "007", "123456789" };
+    static const char *suffixes[] = { "", "", "", "-", "-rc1", "-rc2", "-beta", "-beta.2", "-a-b",
+                                      ".", ".x", "_1", "x", "-RC1", "..1" };
+    static const char *prefixes[] = { "v", "v", "v", "v", "v", "V", "", "vx", "v." };
+
+    char *p = buf, *end = buf + size;
+    p += snprintf(p, end - p, "%s", prefixes[rand() % DIM(prefixes)]);
+    int components = 1 + rand() % 4;
+    for (int i = 0; i < components && p < end; i++) {
+        p += snprintf(p, end - p, "%s%s", i ? "." : "", numbers[rand() % DIM(numbers)]);
+    }
+    if (p < end) {
+        snprintf(p, end - p, "%s", suffixes[rand() % DIM(suffixes)]);
+    }
+}
+
+long now_nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: versions CORPUS [ BATCHES ]\n");
+        return 1;
+    }
+
+    long batches = argc > 2 ? atol(argv[2]) : 100000;
+
+    FILE *file = fopen(argv[1], "r");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    char **corpus = NULL;
+    int corpus_size = 0;
+    char line[ELVEE_VERSION_NAME_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (!*line || *line == '#')
+            continue;
+        corpus = realloc(corpus, (corpus_size + 1) * sizeof(*corpus));
+        corpus[corpus_size++] = strdup(line);
+    }
+    fclose(file);
+
+    // Every ordered pair of the corpus, then random batches.
+
+    long mismatches = 0;
+    for (int i = 0; i < corpus_size; i++) {
+        for (int j = 0; j < corpus_size; j++) {
+            char *pair[] = { corpus[i], corpus[j] };
+            mismatches += check_batch(pair, DIM(pair));
+        }
+    }
+
+    printf("corpus: %d names, %ld mismatches\n", corpus_size, mismatches);
+
+    static char buffers[BATCH_SIZE][ELVEE_VERSION_NAME_SIZE];
+    char *batch[BATCH_SIZE];
+    long fuzz_mismatches = 0;
+    srand(1);
+    for (long n = 0; n < batches; n++) {
+        int count = 1 + rand() % BATCH_SIZE;
+        for (int i = 0; i < count; i++) {
+            batch[i] = buffers[i];
+            if (rand() % 4 == 0) {
+                strcpy(buffers[i], corpus[rand() % corpus_size]);
+            } else {
+                generate_name(buffers[i], sizeof(buffers[i]));
+            }
+        }
+        fuzz_mismatches += check_batch(batch, count);
+    }
+
+    printf("fuzz: %ld batches, %ld mismatches\n", batches, fuzz_mismatches);
+    mismatches += fuzz_mismatches;
+
+    // Time picking the latest of a large batch, taking the best of a few
+    // runs to leave out noise.
+
+    char (*names)[ELVEE_VERSION_NAME_SIZE] = malloc(BENCH_NAMES * sizeof(*names));
+    for (int i = 0; i < BENCH_NAMES; i++) {
+        generate_name(names[i], sizeof(names[i]));
+    }
+
+    long old_best = 0, new_best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        struct old_latest old;
+        old_reset(&old);
+        long start = now_nsec();
+        for (int i = 0; i < BENCH_NAMES; i++) {
+            old_consider(&old, names[i]);
+        }
+        long elapsed = now_nsec() - start;
+        if (!run || elapsed < old_best)
+            old_best = elapsed;
+
+        struct new_latest new;
+        new_reset(&new);
+        start = now_nsec();
+        for (int i = 0; i < BENCH_NAMES; i++) {
+            new_consider(&new, names[i]);
+        }
+        elapsed = now_nsec() - start;
+        if (!run || elapsed < new_best)
+            new_best = elapsed;
+
+        if (strcmp(old.name, new.name)) {
+            printf("Mismatch: old picked \"%s\" but new picked \"%s\" in benchmark\n", old.name, new.name);
+            mismatches++;
+        }
+    }
+
+    printf("old: %.1f ns/name\n", (double)old_best / BENCH_NAMES);
+    printf("new: %.1f ns/name\n", (double)new_best / BENCH_NAMES);
+
+    return mismatches ? 1 : 0;
+}
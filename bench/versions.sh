@@ -0,0 +1,14 @@
+# Builds the version parsing check (see versions.c) and runs it against the
+# corpus in versions.txt. Any argument (BATCHES) is passed on to the check
+# and the environment variable CC selects the compiler (default: clang).
+
+cd "$(dirname "$0")"
+set -e
+
+CC=${CC:-clang}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+$CC -O2 -pthread -o "$work/versions" versions.c ../libelvee.c
+"$work/versions" versions.txt "$@"
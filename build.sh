@@ -1,3 +1,95 @@
+# Builds elvee in one of the following flavors, given as the only argument:
+#
+#   default   plain build (the default)
+#   release   optimized build
+#   lto       optimized build with link-time optimization
+#   min       optimized for size, with unused code and symbols stripped
+#   static    optimized, statically linked against musl (via MUSL_CC, which
+#             defaults to musl-gcc) to save dynamic loading on every launch
+#   pgo       optimized build with link-time and profile-guided optimization,
+#             trained by running the launch benchmark (bench/bench.sh)
+#   lib       libelvee as a static (libelvee.a) and a shared (libelvee.so)
+#             library instead of the program
+#   preload   elvee-preload.so, to preload into programs (Linux and other
+#             ELF systems) to rewrite the templates they launch
+#   bash      elvee-bash.so, loadable bash builtins, using the bash headers
+#             under BASH_INCLUDE (default: /usr/include/bash), then smoke
+#             tested by loading them into bash
+#
+# The environment variable CC selects the compiler (default: clang), CFLAGS
+# adds compiler flags and OUT changes the output path (default: elvee). The
+# lib flavor also checks that libelvee.h compiles as C++ with CXX (default:
+# c++).
+
 cd "$(dirname "$0")"
 set -e
-clang -o elvee elvee.c
+
+CC=${CC:-clang}
+OUT=${OUT:-elvee}
+
+case "${1:-default}" in
+    default)
+        $CC -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ;;
+    release)
+        $CC -O2 -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ;;
+    lto)
+        $CC -O2 -flto -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ;;
+    min)
+        $CC -Os -ffunction-sections -fdata-sections -Wl,--gc-sections -s -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ;;
+    static)
+        ${MUSL_CC:-musl-gcc} -O2 -static -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ;;
+    pgo)
+        profile=$(mktemp -d)
+        trap 'rm -rf "$profile"' EXIT
+        $CC -O2 -fprofile-generate="$profile" -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        ELVEE="$(cd "$(dirname "$OUT")" && pwd)/$(basename "$OUT")" \
+        RUNS=${PGO_RUNS:-100} SIZES=${PGO_SIZES:-"1 100 10000"} SYSCALL_BUDGET=0 \
+            sh bench/bench.sh > /dev/null
+        if $CC --version | grep -q clang; then
+            ${LLVM_PROFDATA:-llvm-profdata} merge -o "$profile/default.profdata" "$profile"
+            $CC -O2 -flto -fprofile-use="$profile/default.profdata" -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        else
+            $CC -O2 -flto -fprofile-use="$profile" -Wno-missing-profile -pthread $CFLAGS -o "$OUT" elvee.c libelvee.c
+        fi
+        ;;
+    lib)
+        # The header is meant to be usable from C++ too.
+        ${CXX:-c++} -fsyntax-only -x c++ libelvee.h
+        $CC -O2 -fPIC $CFLAGS -c -o libelvee.o libelvee.c
+        ar rcs libelvee.a libelvee.o
+        $CC -O2 -fPIC -shared $CFLAGS -o libelvee.so libelvee.c -lpthread
+        rm libelvee.o
+        ;;
+    preload)
+        $CC -O2 -fPIC -shared $CFLAGS -o elvee-preload.so elvee-preload.c libelvee.c -ldl -lpthread
+        ;;
+    bash)
+        inc=${BASH_INCLUDE:-/usr/include/bash}
+        $CC -O2 -fPIC -shared -I"$inc" -I"$inc/include" -I"$inc/builtins" $CFLAGS \
+            -o elvee-bash.so elvee-bash.c libelvee.c -lpthread
+        # Smoke test: load the builtins and use each on a scratch tree.
+        work=$(mktemp -d)
+        trap 'rm -rf "$work"' EXIT
+        mkdir -p "$work/app/v1.0/bin" "$work/app/v2.0/bin"
+        printf '#!/bin/sh\nprintf "%%s|" "$0" "$@"\n' > "$work/app/v2.0/bin/run"
+        chmod +x "$work/app/v2.0/bin/run"
+        out=$(${BASH:-bash} -c '
+            enable -f ./elvee-bash.so elvee_latest elvee_exec &&
+            elvee_latest run "$1/app/?/bin/run" &&
+            [ "$run" = "$1/app/v2.0/bin/run" ] &&
+            elvee_exec "$1/app/?/bin/run" a "b c"' smoke "$work")
+        if [ "$out" != "$work/app/v2.0/bin/run|a|b c|" ]; then
+            echo "Smoke test of elvee-bash.so failed: $out" >&2
+            exit 1
+        fi
+        ;;
+    *)
+        echo "Unknown build flavor: $1" >&2
+        exit 1
+        ;;
+esac
@@ -0,0 +1,186 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Loadable bash builtins that resolve templates (as taken by elvee) within
+// the shell itself, without forking:
+//
+//     enable -f /path/to/elvee-bash.so elvee_latest elvee_exec
+//
+//     elvee_latest VAR TEMPLATE
+//     elvee_exec TEMPLATE [ ARG... ]
+//
+// The first sets the shell variable VAR to the path that TEMPLATE resolves
+// to and the second replaces the shell with it, like the exec builtin. The
+// latest version of each search directory is cached for the life of the
+// shell and revalidated against the time stamps of the directory.
+//
+// Building requires the headers that bash installs for loadable builtins
+// (e.g. the bash-builtins package on Debian).
+
+#include <config.h>
+
+#if defined (HAVE_UNISTD_H)
+#  include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "loadables.h"
+
+#include "libelvee.h"
+
+static struct elvee_cache *cache;
+
+// Resolves "tmpl" into "buf" of "len" characters, reporting any error
+// as coming from the builtin. Returns 0 on success or -1 on failure.
+
+static int resolve_template(char *tmpl, char *buf, size_t len)
+{
+    char search_path[PATH_MAX];
+    const char *sub_path;
+
+    if (!cache) {
+        cache = elvee_cache_create(); // resolves uncached if this fails
+    }
+
+    if (elvee_split_template(tmpl, search_path, sizeof(search_path), &sub_path)
+        || elvee_resolve_cached(cache, search_path, sub_path, buf, len)) {
+        builtin_error("%s: %s", tmpl, errno == EINVAL ? "invalid template" : strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int elvee_latest_builtin(WORD_LIST *list)
+{
+    if (no_options(list))
+        return EX_USAGE;
+    list = loptend;
+
+    if (!list || !list->next || list->next->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    char *name = list->word->word;
+    if (!legal_identifier(name)) {
+        sh_invalidid(name);
+        return EXECUTION_FAILURE;
+    }
+
+    char path[PATH_MAX];
+    if (resolve_template(list->next->word->word, path, sizeof(path)))
+        return EXECUTION_FAILURE;
+
+    return bind_variable(name, path, 0) ? EXECUTION_SUCCESS : EXECUTION_FAILURE;
+}
+
+int elvee_exec_builtin(WORD_LIST *list)
+{
+    if (no_options(list))
+        return EX_USAGE;
+    list = loptend;
+
+    if (!list) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    char path[PATH_MAX];
+    if (resolve_template(list->word->word, path, sizeof(path)))
+        return EXECUTION_FAILURE;
+
+    // Hand the resolved path and the ARGs over to the exec builtin itself,
+    // after "--" so a path starting with a hyphen isn't taken for an option.
+    // The shell is then replaced exactly as by exec (SHLVL, traps, signals,
+    // job control, redirections and execfail included). Like the shim, the
+    // resolved path is passed as the first argument.
+
+    sh_builtin_func_t *exec = find_shell_builtin("exec");
+    if (!exec) {
+        builtin_error("exec: builtin not available");
+        return EXECUTION_FAILURE;
+    }
+
+    WORD_LIST *words = make_word_list(make_word("--"), make_word_list(make_word(path), list->next));
+    int status = exec(words);
+
+    words->next->next = NULL; // the ARGs still belong to the caller
+    dispose_words(words);
+    return status;
+}
+
+int elvee_latest_builtin_load(char *name)
+{
+    return 1;
+}
+
+void elvee_latest_builtin_unload(char *name)
+{
+    elvee_cache_destroy(cache);
+    cache = NULL;
+}
+
+char *elvee_latest_doc[] = {
+    "Resolve the latest version of a program.",
+    "",
+    "Sets the shell variable VAR to the path that TEMPLATE resolves to,",
+    "where TEMPLATE is SEARCH_PATH/?/SUB_PATH and ? stands for the latest",
+    "version directory under SEARCH_PATH. The latest version of each search",
+    "directory is cached until the directory changes.",
+    "",
+    "Exit Status:",
+    "Returns success unless TEMPLATE cannot be resolved or VAR is invalid.",
+    (char *)NULL
+};
+
+char *elvee_exec_doc[] = {
+    "Replace the shell with the latest version of a program.",
+    "",
+    "Resolves TEMPLATE like elvee_latest and executes the resulting path",
+    "with the ARGs, replacing the shell like exec. If it cannot be executed,",
+    "a non-interactive shell exits, unless the shell option execfail is set.",
+    "",
+    "Exit Status:",
+    "Returns failure only if TEMPLATE cannot be resolved or executed.",
+    (char *)NULL
+};
+
+struct builtin elvee_latest_struct = {
+    "elvee_latest",
+    elvee_latest_builtin,
+    BUILTIN_ENABLED,
+    elvee_latest_doc,
+    "elvee_latest VAR TEMPLATE",
+    0
+};
+
+struct builtin elvee_exec_struct = {
+    "elvee_exec",
+    elvee_exec_builtin,
+    BUILTIN_ENABLED,
+    elvee_exec_doc,
+    "elvee_exec TEMPLATE [ARG...]",
+    0
+};
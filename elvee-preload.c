@@ -0,0 +1,207 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// A shared object to preload (via LD_PRELOAD) into programs that launch
+// others by hard-coded paths so that those paths can be templates, just like
+// the first argument of elvee:
+//
+//     SEARCH_PATH "/?/" SUB_PATH
+//
+// The exec family of functions and posix_spawn are intercepted and any path
+// containing the "/?/" token is rewritten to the latest version directory
+// before calling the real function, so that the target is launched directly
+// without going through the shim. Paths that don't resolve are passed on as
+// they are. Answers are cached for the life of the process and revalidated
+// with a single stat of the search directory.
+//
+// Verbose logging to STDERR is enabled if an environment variable named
+// `ELVEE_VERBOSE` or `elvee_verbose` is defined and its value is anything
+// but 0.
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libelvee.h"
+
+#define TEMPLATE_TOKEN "/?/"
+
+#define real(name) \
+    static typeof(&name) real_##name; \
+    if (!real_##name) { \
+        real_##name = (typeof(&name))dlsym(RTLD_NEXT, #name); \
+    }
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct elvee_cache *cache;
+static int verbose;
+
+// Resolutions are serialized under a lock that is also taken around a fork
+// so that the child never inherits the cache in the middle of an update by
+// another thread.
+
+static void fork_prepare(void) { pthread_mutex_lock(&lock); }
+static void fork_release(void) { pthread_mutex_unlock(&lock); }
+
+static void init(void)
+{
+    char *value = getenv("ELVEE_VERBOSE");
+    if (!value) {
+        value = getenv("elvee_verbose");
+    }
+    verbose = value && *value && strcmp(value, "0");
+    cache = elvee_cache_create();
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+}
+
+// Returns the path to launch in place of "path": either "path" itself if it
+// isn't a template or doesn't resolve, or the resolved path copied to "buf"
+// of "len" characters.
+
+static const char *rewrite(const char *path, char *buf, size_t len)
+{
+    if (!path || !strstr(path, TEMPLATE_TOKEN))
+        return path;
+
+    pthread_once(&once, init);
+
+    int saved_errno = errno;
+    char search_path[PATH_MAX];
+    const char *sub_path;
+
+    pthread_mutex_lock(&lock);
+    int failed = elvee_split_template(path, search_path, sizeof(search_path), &sub_path)
+              || elvee_resolve_cached(cache, search_path, sub_path, buf, len);
+    pthread_mutex_unlock(&lock);
+
+    if (verbose) {
+        fprintf(stderr, "elvee-preload: %s -> %s\n", path, failed ? strerror(errno) : buf);
+    }
+
+    errno = saved_errno;
+    return failed ? path : buf;
+}
+
+int execve(const char *path, char *const argv[], char *const envp[])
+{
+    real(execve);
+    char buf[PATH_MAX];
+    return real_execve(rewrite(path, buf, sizeof(buf)), argv, envp);
+}
+
+int execv(const char *path, char *const argv[])
+{
+    real(execv);
+    char buf[PATH_MAX];
+    return real_execv(rewrite(path, buf, sizeof(buf)), argv);
+}
+
+int execvp(const char *file, char *const argv[])
+{
+    real(execvp);
+    char buf[PATH_MAX];
+    return real_execvp(rewrite(file, buf, sizeof(buf)), argv);
+}
+
+int execvpe(const char *file, char *const argv[], char *const envp[])
+{
+    real(execvpe);
+    char buf[PATH_MAX];
+    return real_execvpe(rewrite(file, buf, sizeof(buf)), argv, envp);
+}
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+    real(posix_spawn);
+    char buf[PATH_MAX];
+    return real_posix_spawn(pid, rewrite(path, buf, sizeof(buf)), file_actions, attrp, argv, envp);
+}
+
+int posix_spawnp(pid_t *pid, const char *file,
+                 const posix_spawn_file_actions_t *file_actions,
+                 const posix_spawnattr_t *attrp,
+                 char *const argv[], char *const envp[])
+{
+    real(posix_spawnp);
+    char buf[PATH_MAX];
+    return real_posix_spawnp(pid, rewrite(file, buf, sizeof(buf)), file_actions, attrp, argv, envp);
+}
+
+// The list variants are implemented in terms of the vector ones above since
+// the C library calls its own internals rather than anything interposed. The
+// arguments (up to and including the terminating NULL) are collected into an
+// array on the stack. The C library declares the first argument as non-null,
+// which would let the compiler drop the test for a NULL one (that
+// terminates the list right away), so its value is hidden from the compiler
+// before being tested.
+
+#define collect_args(arg0, args, argv) \
+    va_list args; \
+    int argc = 0; \
+    const char *first = arg0; \
+    __asm__("" : "+r"(first)); \
+    if (first) { \
+        va_start(args, arg0); \
+        for (argc = 1; va_arg(args, char *); argc++) \
+            ; \
+        va_end(args); \
+    } \
+    char *argv[argc + 1]; \
+    argv[0] = (char *)arg0; \
+    va_start(args, arg0); \
+    for (int i = 1; i <= argc; i++) { \
+        argv[i] = va_arg(args, char *); \
+    }
+
+int execl(const char *path, const char *arg0, ...)
+{
+    collect_args(arg0, args, argv);
+    va_end(args);
+    return execv(path, argv);
+}
+
+int execlp(const char *file, const char *arg0, ...)
+{
+    collect_args(arg0, args, argv);
+    va_end(args);
+    return execvp(file, argv);
+}
+
+int execle(const char *path, const char *arg0, ...)
+{
+    collect_args(arg0, args, argv);
+    char *const *envp = va_arg(args, char *const *);
+    va_end(args);
+    return execve(path, argv, envp);
+}
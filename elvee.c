@@ -38,7 +38,31 @@
 #endif
 #include <sys/types.h>
 #ifndef WINDOWS
+#include <alloca.h>
+#include <sys/time.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifndef WINDOWS
 #include <sys/wait.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <elf.h>
+#include <link.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/un.h>
+#endif
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #endif
 
 #ifdef WINDOWS
@@ -50,18 +74,41 @@
 
 #define PATH_SEPARATOR_CHAR '\\'
 #define PATH_SEPARATOR      "\\"
+#define PATH_LIST_SEPARATOR_CHAR ';'
 
 #else // *nix
 
 #define PATH_SEPARATOR_CHAR '/'
 #define PATH_SEPARATOR      "/"
+#define PATH_LIST_SEPARATOR_CHAR ':'
+
+extern char **environ;
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
 
 #endif
 
 #include "include/struct.h"
+#include "libelvee.h"
+
+// Statically-defined tracing (USDT/SDT) probes are compiled in when the
+// system provides <sys/sdt.h> (e.g. from systemtap-sdt-dev on Debian). They
+// cost a single NOP each when not attached to by tools like perf or bpftrace.
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_SDT
+#endif
+#endif
 
 #define DIM(x) (sizeof(x) / sizeof((x)[0]))
 
+#define VERSION_NAME_SIZE (fldsiz(dirent, d_name) / sizeof(char))
+
 #define print_op_error(op) \
     fprintf(stderr, "Operation '%s' failed due to:\n%s\nat: %s:%d\n", (op), strerror(errno), __FILE__, __LINE__)
 
@@ -78,10 +125,49 @@
     fprintf(stderr, "%s(%d):" format "\n", __FILE__, __LINE__, __VA_ARGS__)
 
 int verbose = 0;
+int exec_mode = 0;
+int cache_mode = 0;
+int collapse_mode = 0;
+int inherit_mode = 0;
 
 #define vlog(format, ...) \
     if (verbose) { log(format, __VA_ARGS__); }
 
+// Phases of a launch that are timed when tracing. Each phase runs from the
+// end of the previous one to its own end; a phase may end more than once, in
+// which case its durations add up.
+
+#define TRACE_PHASES(X)  \
+    X(ENV     , "env"     ) /* reading the environment */                 \
+    X(SELF    , "self"    ) /* locating this program */                   \
+    X(TEMPLATE, "template") /* parsing the template argument */           \
+    X(LOOKUP  , "lookup"  ) /* current link, index, daemon and cache */   \
+    X(OPENDIR , "opendir" ) /* opening the search directory */            \
+    X(SCAN    , "scan"    ) /* scanning the search directory */           \
+    X(PATH    , "path"    ) /* building the target path and arguments */  \
+    X(SPAWN   , "spawn"   ) /* spawning the target (zero if exec'ing) */
+
+#define TRACE_PHASE_ENUM(id, name) PHASE_##id,
+#define TRACE_PHASE_NAME(id, name) name,
+
+enum phase { TRACE_PHASES(TRACE_PHASE_ENUM) PHASE_COUNT };
+char *phase_names[] = { TRACE_PHASES(TRACE_PHASE_NAME) };
+
+int trace = 0;
+long long start_ns, trace_mark_ns;
+long long run_start_ns; // end of resolution, from which the target is timed
+long long entries_scanned = 0;
+long long phase_ns[PHASE_COUNT];
+
+#ifdef HAVE_SDT
+#define sdt_phase(p) DTRACE_PROBE2(elvee, phase, (p), phase_names[p])
+#else
+#define sdt_phase(p)
+#endif
+
+#define trace_phase(phase) \
+    do { sdt_phase(phase); if (trace) { trace_end_phase(phase); } } while (0)
+
 #undef min
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
@@ -91,55 +177,426 @@ int verbose = 0;
 
 char program_name[] = PROGRAM_NAME;
 
+#ifdef __linux__
+
+// Every build of this program carries an ELF note (Linux only) so that a shim
+// can tell when the target it resolved is another shim, such as a renamed
+// copy shipped inside a versioned bundle, and resolve on its behalf rather
+// than launching it. The descriptor of the note is the revision of the rules
+// by which a shim resolves its target; a shim only resolves on behalf of
+// another that follows the same ones. A chain of shims is followed for at
+// most MAX_HOPS shims so that a loop can't spin forever.
+
+#define SHIM_NOTE_NAME     PROGRAM_NAME
+#define SHIM_NOTE_TYPE     1
+#define SHIM_NOTE_REVISION 1
+#define MAX_HOPS           8
+
+#define stringify(x) #x
+#define xstringify(x) stringify(x)
+
+__asm__(
+    ".pushsection .note." PROGRAM_NAME ", \"a\", @note\n"
+    ".balign 4\n"
+    ".long 2f - 1f\n" // name size
+    ".long 4f - 3f\n" // descriptor size
+    ".long " xstringify(SHIM_NOTE_TYPE) "\n"
+    "1: .asciz \"" SHIM_NOTE_NAME "\"\n"
+    "2: .balign 4\n"
+    "3: .long " xstringify(SHIM_NOTE_REVISION) "\n"
+    "4: .popsection\n"
+);
+
+int is_shim(char *path);
+
+#endif
+
 void help();
 void license();
 void timestamp();
 int ascii_strcmpi(char *s1, char *s2);
 char *argv_quote(char *arg);
+int env_flag(char *name_upper, char *name_lower);
+long long clock_ns();
+void trace_end_phase(enum phase phase);
+void trace_report();
+void inherit_export(char *path, char *lname);
+char *env_value(char *name_upper, char *name_lower);
+int find_latest_version(char *path, char *lname);
+
+// Sources that the latest version can be resolved from.
+
+enum source {
+    SOURCE_NONE,
+    SOURCE_INHERITED, // passed on by the launching process
+    SOURCE_CURRENT,   // current link
+    SOURCE_INDEX,     // index published by the daemon
+    SOURCE_DAEMON,    // daemon
+    SOURCE_CACHE,     // resolution cache
+    SOURCE_SCAN,      // full scan
+    SOURCE_COUNT
+};
+
+char *source_names[] = { "none", "inherited", "current", "index", "daemon", "cache", "scan" };
+
+int split_path(char *path, char *fname);
+int parse_template(char *template, char *path, char *fname);
+int next_level(char *path, char *lname, char *fname);
+enum source resolve_search_path(char *path, char *lname);
+enum source resolve_target(char *path, char *lname, char *fname);
+enum source resolve_version(char *path, char *lname);
+int format_spawn_path(char *spawn_path, char *path, char *lname, char *fname);
+
+// Search roots, i.e. the search directory of the target followed by those
+// listed in an environment variable named `ELVEE_PATH` or `elvee_path`, are
+// resolved concurrently and the latest version among them wins.
+
+#define MAX_ROOTS 16
+
+struct root {
+    char path[PATH_MAX];
+    char lname[VERSION_NAME_SIZE];
+    enum source resolved;
+};
+
+enum source resolve_roots(char *path, char *roots, int prefer_last, char *lname);
+int resolve(int argc, char **argv);
+
+#ifndef WINDOWS
+
+int activate(int argc, char **argv, char *self_path);
+void print_sh_quoted(char *s);
+
+// Spawn backends for when this program stays around as the parent of the
+// target. Each starts "path" as a child and returns its process ID or -1
+// with errno set on failure.
+
+pid_t spawn_posix(char *path, char **argv);
+pid_t spawn_fork(char *path, char **argv);
+
+struct spawner {
+    char *name;
+    pid_t (*spawn)(char *path, char **argv);
+} spawners[] = {
+    { "posix_spawn", spawn_posix }, // default
+    { "fork"       , spawn_fork  },
+};
+
+// The resolution cache holds one entry file per search directory, named
+// after its device and inode numbers. An entry records the latest version
+// directory name (empty if none was found) along with the modification and
+// change times of the search directory at the time it was scanned so that it
+// can be validated with a single stat.
+
+#define CACHE_MAGIC "elvee\0\1"
+
+struct cache_entry {
+    char magic[8];
+    unsigned long long dev, ino;
+    long long mtime_sec, mtime_nsec;
+    long long ctime_sec, ctime_nsec;
+    char name[VERSION_NAME_SIZE];
+};
+
+// Name of the symbolic link, under a search directory, that the "promote"
+// command points to the latest version directory.
+
+#define CURRENT_LINK_NAME ELVEE_CURRENT_LINK_NAME
+
+int promote(char *path);
+
+#ifdef __linux__
+
+// The resolver daemon answers queries for the latest version under a search
+// directory over a Unix socket. Queries and answers are single lines:
+//
+//     query:  ABSOLUTE_SEARCH_PATH "\n"
+//     answer: "+" VERSION_NAME "\n"   (latest version found)
+//           | "-" "\n"                (no version found)
+//           | "!" "\n"                (error; client should scan)
+//
+// The daemon remembers the answer per search directory and watches each with
+// inotify so that it's forgotten as soon as an entry is added, removed or
+// renamed.
+
+#define DAEMON_TIMEOUT_MSEC 50
+#define DAEMON_MAX_ENTRIES  4096
+
+struct daemon_entry {
+    char *path;
+    int wd;     // inotify watch descriptor or -1 if not watched
+    int valid;  // whether "lname" is current
+    char lname[VERSION_NAME_SIZE];
+};
+
+struct daemon {
+    int ifd;                      // inotify instance
+    struct daemon_entry *entries;
+    int count;
+    struct index *index;          // published index or NULL if none
+};
+
+// The daemon can also publish what it knows into an index file (typically
+// under /dev/shm) that every shim maps read-only and looks up without any
+// round trip to the daemon. The index is an open-addressing hash table of
+// fixed-size slots keyed on the search path. Each slot is guarded by a
+// sequence lock: its sequence number is odd while the daemon (the only
+// writer) updates it, and a reader retries or gives up if the number changed
+// while it was reading. The daemon also stamps the index periodically so
+// that readers can tell when it has stopped keeping it current.
+
+#define INDEX_MAGIC      "elveeix1"
+#define INDEX_SLOTS      1024
+#define INDEX_PATH_SIZE  512
+#define INDEX_STALE_SEC  5
+
+struct index_slot {
+    unsigned int seq;   // odd while the slot is being updated
+    int valid;          // whether "lname" is current
+    char path[INDEX_PATH_SIZE];
+    char lname[VERSION_NAME_SIZE];
+};
+
+struct index {
+    char magic[8];
+    long long heartbeat; // CLOCK_MONOTONIC seconds of the publisher's last update
+    struct index_slot slots[INDEX_SLOTS];
+};
+
+struct index *index_create(char *index_path);
+void index_publish(struct index *index, char *path, char *lname, int valid);
+int index_lookup(char *index_path, char *path, char *lname);
+
+int daemon_run(char *socket_path, char *index_path);
+int daemon_query(char *socket_path, char *path, char *lname);
+
+// Page cache statistics of a tree of files gathered by the "warm" command.
+
+struct warm_stats {
+    unsigned long long files;
+    unsigned long long bytes;   // total size of the files
+    unsigned long long changed; // bytes requested or dropped
+};
+
+int warm(int argc, char **argv);
+void warm_walk(int dfd, int advice, struct warm_stats *stats);
+unsigned long long resident_bytes(int fd, off_t size);
+int running_paths(char ***paths);
+int add_running_path(char ***paths, int count, char *path);
+int compare_paths(const void *a, const void *b);
+
+#endif
+
+// The journal is a file of fixed-size records, one per launch, each appended
+// with a single write to a file opened with O_APPEND so that concurrent
+// launches never interleave or lock.
+
+#define JOURNAL_TAG "ELJ1"
+
+struct journal_record {
+    char tag[4];
+    int pid;                // of the target (same as this program if exec'd)
+    int status;             // exit code of the target or -1 if unknown
+    int reserved;
+    long long time_ns;      // wall-clock time at launch since the epoch
+    long long resolve_ns;   // time taken to resolve the target
+    long long wall_ns;      // time the target ran (see run_start_ns) or -1
+    char name[64];          // program name or sub-path (truncated)
+    char path[256];         // search directory (truncated)
+    char version[VERSION_NAME_SIZE];
+};
+
+void journal_record_init(struct journal_record *record, char *name, char *path, char *version);
+void journal_append(char *journal_path, struct journal_record *record);
+int journal(int argc, char **argv);
+
+// The statistics file holds counters per search path and version that every
+// launch updates in place, through a shared memory mapping, with atomic
+// increments. It's laid out as an open-addressing hash table of fixed-size
+// slots. A slot is claimed for a new search path and version by atomically
+// moving its state from empty to claimed, filling its key and then moving
+// it to ready. A launch that finds a slot in the claimed state doesn't wait
+// for it and just goes uncounted. Durations are counted in histograms of
+// log2 buckets of microseconds where bucket N counts durations under 2^N
+// microseconds (but not under 2^(N-1)) and the last bucket counts the rest.
+
+#define STATS_MAGIC    "elveest2"
+#define STATS_SLOTS    1024
+#define STATS_PATH_SIZE 256
+#define STATS_BUCKETS  40
+
+enum { STATS_EMPTY, STATS_CLAIMED, STATS_READY };
+
+struct stats_histogram {
+    unsigned long long buckets[STATS_BUCKETS];
+    unsigned long long sum_us;
+};
+
+struct stats_slot {
+    unsigned int state;
+    unsigned int hash;
+    char path[STATS_PATH_SIZE];
+    char version[VERSION_NAME_SIZE];
+    unsigned long long launches;
+    unsigned long long resolutions[SOURCE_COUNT]; // by source
+    unsigned long long entries_scanned;
+    unsigned long long runs, failed_runs;         // unless exec'd
+    struct stats_histogram resolve;               // time to resolve
+    struct stats_histogram run;                   // run time of target
+};
+
+struct stats {
+    char magic[8];
+    struct stats_slot slots[STATS_SLOTS];
+};
+
+struct stats_slot *stats_slot_open(char *stats_path, char *path, char *version);
+void stats_count_launch(struct stats_slot *slot, enum source source, long long resolve_ns);
+void stats_count_run(struct stats_slot *slot, int succeeded);
+int stats(int argc, char **argv);
+
+// A launch passes the latest version of each search directory it resolved on
+// to the process tree of its target through environment variables named
+// after the hash of the absolute search path, e.g.:
+//
+//     ELVEE_ROOT_1A2B3C4D=v4.2
+//
+// so that shims launched further down the tree use the very same versions
+// without scanning again.
+
+#define INHERIT_PREFIX PROGRAM_NAME_UPPER "_ROOT_"
+
+int inherit_lookup(char *path, char *lname);
+
+int cache_dir_path(char *buf, size_t size);
+void cache_dir_create(char *dir_path);
+int cache_entry_path(struct stat *st, char *buf, size_t size);
+int cache_read(char *cache_path, struct stat *st, char *lname);
+void cache_write(char *cache_path, struct stat *st, char *lname);
+
+#endif
 
 int main(int argc, char **argv)
 {
+    // Time the phases of the launch and report their durations to STDERR if
+    // an environment variable named `ELVEE_TRACE` or `elvee_trace` is
+    // defined and its value is anything but 0.
+
+    if ((trace = env_flag(PROGRAM_NAME_UPPER "_TRACE", PROGRAM_NAME "_trace"))) {
+        start_ns = trace_mark_ns = clock_ns();
+    }
+
+#ifndef WINDOWS
+
+    // Append a record of the launch to a journal file (*nix only) if an
+    // environment variable named `ELVEE_JOURNAL` or `elvee_journal` is
+    // defined to be its path.
+
+    char *journal_path = env_value(PROGRAM_NAME_UPPER "_JOURNAL", PROGRAM_NAME "_journal");
+    struct journal_record record;
+    if (journal_path && !*journal_path) {
+        journal_path = NULL;
+    }
+
+    // Count launches in a statistics file (*nix only) if an environment
+    // variable named `ELVEE_STATS` or `elvee_stats` is defined to be its
+    // path.
+
+    char *stats_path = env_value(PROGRAM_NAME_UPPER "_STATS", PROGRAM_NAME "_stats");
+    struct stats_slot *stats_slot = NULL;
+    if (stats_path && !*stats_path) {
+        stats_path = NULL;
+    }
+
+    if (!trace && (journal_path || stats_path)) {
+        start_ns = clock_ns();
+    }
+
+#endif
+
     // Enable verbose logging to STDERR if an environment variable named
     // `ELVEE_VERBOSE` or `elvee_verbose` is defined and its value is
     // anything but 0.
 
-    char *verbose_env;
-    if (!(verbose_env = getenv(PROGRAM_NAME_UPPER "_VERBOSE"))) {
-        if (!(verbose_env = getenv(PROGRAM_NAME "_verbose"))) {
-            verbose_env = "0";
+    verbose = env_flag(PROGRAM_NAME_UPPER "_VERBOSE", PROGRAM_NAME "_verbose");
+
+    // Replace this process with the target program instead of running it as
+    // a child (*nix only) if an environment variable named `ELVEE_EXEC` or
+    // `elvee_exec` is defined and its value is anything but 0.
+
+    exec_mode = env_flag(PROGRAM_NAME_UPPER "_EXEC", PROGRAM_NAME "_exec");
+
+    // Cache the latest version found per search directory (*nix only) if an
+    // environment variable named `ELVEE_CACHE` or `elvee_cache` is defined
+    // and its value is anything but 0.
+
+    cache_mode = env_flag(PROGRAM_NAME_UPPER "_CACHE", PROGRAM_NAME "_cache");
+
+    // Resolve on behalf of a target that is itself a shim (Linux only) if an
+    // environment variable named `ELVEE_COLLAPSE` or `elvee_collapse` is
+    // defined and its value is anything but 0. It's opt-in because telling
+    // whether the target is a shim costs an open and a few reads per launch.
+
+    collapse_mode = env_flag(PROGRAM_NAME_UPPER "_COLLAPSE", PROGRAM_NAME "_collapse");
+
+    // Pass the versions resolved on to the target, and use those passed on
+    // by the launching process (*nix only), if an environment variable named
+    // `ELVEE_INHERIT` or `elvee_inherit` is defined and its value is anything
+    // but 0.
+
+    inherit_mode = env_flag(PROGRAM_NAME_UPPER "_INHERIT", PROGRAM_NAME "_inherit");
+
+#ifndef WINDOWS
+
+    // Select the backend used to spawn the target as a child (*nix only) by
+    // name from an environment variable named `ELVEE_SPAWN` or `elvee_spawn`.
+
+    struct spawner *spawner = &spawners[0];
+    char *spawner_env;
+    if ((spawner_env = env_value(PROGRAM_NAME_UPPER "_SPAWN", PROGRAM_NAME "_spawn")) && *spawner_env) {
+        for (spawner = spawners; spawner < spawners + DIM(spawners) && strcmp(spawner->name, spawner_env); spawner++)
+            ;
+        if (spawner == spawners + DIM(spawners)) {
+            printf_app_error("Unknown spawn backend: %s", spawner_env);
+            return 1;
         }
     }
-    verbose = strcmp("0", verbose_env) ? 1 : 0;
 
-    // Get the absolute path of this program.
+    vlog("spawn: %s", spawner->name);
+
+#endif
+
+    trace_phase(PHASE_ENV);
+
+    // Get the absolute path of this program. On Linux, the kernel already
+    // knows it so it's read in one go rather than resolving the first
+    // argument, which walks every component of the path and is wrong when
+    // this program was found via PATH (the first argument then has no
+    // directory).
 
     char path[PATH_MAX];
     char fname[NAME_MAX];
-    if (!realpath(argv[0], path)) {
+    int located = 0;
+#ifdef __linux__
+    ssize_t path_len = readlink("/proc/self/exe", path, DIM(path));
+    if ((located = path_len > 0 && path_len < DIM(path))) {
+        path[path_len] = 0;
+    }
+#endif
+    if (!located && !realpath(argv[0], path)) {
         print_op_error("realpath");
         return 1;
     }
 
-    // Split program directory path and file name.
-
-    char *pathsep = strrchr(path, PATH_SEPARATOR_CHAR);
-    if (strlen(pathsep + 1) >= DIM(fname)) {
-        printf_app_error("File name is too long: %s", pathsep + 1);
+    if (split_path(path, fname)) {
         return 1;
     }
-    strcpy(fname, pathsep + 1);
-    *pathsep = 0;
-
-    // Blow away the file extension, if any.
-
-    char *ext = strrchr(fname, '.');
-    if (ext) {
-        *ext = 0;
-    }
 
     vlog("path: %s", path);
     vlog("fname: %s", fname);
 
+    trace_phase(PHASE_SELF);
+
     // Has this program been renamed? If so then it will only look for that
     // program's versions in sub-directories. Otherwise, the first argument is
     // a template string that must have the token `\?\` (Windows) or `/?/`
@@ -169,111 +626,143 @@ int main(int argc, char **argv)
             timestamp();
             return 0;
         }
-        vlog("template: %s", template);
-        char token[] = PATH_SEPARATOR "?" PATH_SEPARATOR;
-        char *tt = strstr(template, token);
-        if (!tt) {
-            printf_app_error("Invalid template argument: %s", template);
+        if (0 == strcmp(template, "daemon")) {
+#ifdef __linux__
+            char *socket_path = argv[2] ? argv[2] : env_value(PROGRAM_NAME_UPPER "_DAEMON", PROGRAM_NAME "_daemon");
+            if (!socket_path || !*socket_path) {
+                print_app_error("Missing socket path argument.");
+                return 1;
+            }
+            char *index_path = env_value(PROGRAM_NAME_UPPER "_INDEX", PROGRAM_NAME "_index");
+            return daemon_run(socket_path, index_path && *index_path ? index_path : NULL);
+#else
+            print_app_error("The daemon command is only supported on Linux.");
+            return 1;
+#endif
+        }
+        if (0 == strcmp(template, "journal")) {
+#ifndef WINDOWS
+            return journal(argc - 2, argv + 2);
+#else
+            print_app_error("The journal command is not supported on Windows.");
+            return 1;
+#endif
+        }
+        if (0 == strcmp(template, "stats")) {
+#ifndef WINDOWS
+            return stats(argc - 2, argv + 2);
+#else
+            print_app_error("The stats command is not supported on Windows.");
+            return 1;
+#endif
+        }
+        if (0 == strcmp(template, "promote")) {
+#ifndef WINDOWS
+            if (!argv[2]) {
+                print_app_error("Missing search path argument.");
+                return 1;
+            }
+            return promote(argv[2]);
+#else
+            print_app_error("The promote command is not supported on Windows.");
             return 1;
+#endif
+        }
+        if (0 == strcmp(template, "resolve")) {
+            return resolve(argc - 2, argv + 2);
+        }
+        if (0 == strcmp(template, "warm")) {
+#ifdef __linux__
+            return warm(argc - 2, argv + 2);
+#else
+            print_app_error("The warm command is only supported on Linux.");
+            return 1;
+#endif
+        }
+        if (0 == strcmp(template, "env")) {
+#ifndef WINDOWS
+            // split_path only cut "path" short at the last separator so the
+            // file name, as is (unlike "fname", which lost its extension),
+            // still follows the directory in the buffer.
+
+            char *self_name = path + strlen(path) + 1;
+            char self_path[PATH_MAX];
+            if (snprintf(self_path, DIM(self_path), "%s%s%s", path, PATH_SEPARATOR, self_name) >= DIM(self_path)) {
+                print_app_error("Program path is too long!");
+                return 1;
+            }
+            return activate(argc - 2, argv + 2, self_path);
+#else
+            print_app_error("The env command is not supported on Windows.");
+            return 1;
+#endif
         }
-        strncpy(path, template, tt - template);
-        path[tt - template] = 0;
-        if (snprintf(fname, DIM(fname), "%s", tt + DIM(token) - 1) >= DIM(fname)) {
-            print_app_error("Trailer path is too long!");
+        if (parse_template(template, path, fname)) {
+            return 1;
         }
     }
 
-    // Scan the directory for sub-directories whose name conforms to the
-    // following pattern:
-    //
-    //     "v" MAJOR [ "." MINOR [ "." PATCH ] ] [ "-" SUFFIX ]
-    //
-    // where MAJOR, MINOR and PATCH must be (when present) non-negative decimal
-    // integers. The SUFFIX is any string of characters and compared verbatim.
+    trace_phase(PHASE_TEMPLATE);
 
-    vlog("opendir: %s", path);
-    DIR *d; d = opendir(path);
-    if (!d) {
-        print_op_error("opendir");
+    // Find the latest version directory.
+
+    char lname[VERSION_NAME_SIZE] = { 0 };
+    enum source resolved = resolve_target(path, lname, fname);
+    if (!resolved) {
         return 1;
     }
 
-    char lname[fldsiz(dirent, d_name) / sizeof(char)] = { 0 };
-    char lsuffix[DIM(lname)] = { 0 };
-    unsigned int lmajor = 0, lminor = 0, lpatch = 0;
-    struct dirent *dir;
-
-    while ((errno = 0, dir = readdir(d)) != NULL) {
+    // Build up the path to the program to spawn.
 
-        // Consider only directories that start with "v".
+    char spawn_path[PATH_MAX];
+    if (format_spawn_path(spawn_path, path, lname, fname)) {
+        return 1;
+    }
 
-        int ignore = dir->d_type != DT_DIR || dir->d_name[0] != 'v';
-        vlog("dir[%s]: (%x) %s", ignore ? "x" : " ", dir->d_type, dir->d_name);
-        if (ignore)
-            continue;
+#ifdef __linux__
 
-        // Parse out tokens from the directory name.
+    // If the target is itself a shim then resolve its target here, and so on
+    // down the chain, instead of paying for a launch per shim. A shim that
+    // still has its original name needs a template argument of its own so it
+    // is launched as is.
 
-        int major = 0, minor = 0, patch = 0;
-        char suffix[DIM(lsuffix)] = { 0 };
-        int tokens;
-        if ((tokens = sscanf(dir->d_name, "v%u.%u.%u%s", &major, &minor, &patch, suffix)) < 3) {
-            if ((tokens = sscanf(dir->d_name, "v%u.%u%s", &major, &minor, suffix)) < 2) {
-                tokens = sscanf(dir->d_name, "v%u%s", &major, suffix);
-            }
+    for (int hops = 0; collapse_mode && is_shim(spawn_path); ) {
+        if (++hops > MAX_HOPS) {
+            printf_app_error("Too many chained shims (more than %d): %s", MAX_HOPS, spawn_path);
+            return 1;
         }
-
-        if (!tokens) // no tokens then loop around
-            continue;
-
-        // Suffix must begin with a hyphen (-).
-
-        int invalid_suffix = *suffix && *suffix != '-';
-        vlog("tokens(%d): %u.%u.%u%s%s", tokens, major, minor, patch, suffix, invalid_suffix ? " (invalid suffix)" : "");
-        if (invalid_suffix)
-            continue;
-
-        // Does this entry sort higher than the last we know? Then...
-
-        int upgrade
-            =   major > lmajor
-            || (major == lmajor && minor > lminor)
-            || (major == lmajor && minor == lminor && patch > lpatch)
-            || (major == lmajor && minor == lminor && patch == lpatch
-                && *suffix && *lsuffix
-                && strncmp(suffix, lsuffix, min(1 + strlen(suffix), 1 + strlen(lsuffix))) > 0);
-
-        vlog("upgrade: %u.%u.%u%s > %u.%u.%u%s ? %s", major, minor, patch, suffix, lmajor, lminor, lpatch, lsuffix, upgrade ? "yes" : "no");
-
-        if (upgrade) {
-            lmajor = major; // ... upgrade!
-            lminor = minor;
-            lpatch = patch;
-            strcpy(lsuffix, suffix);
-            strcpy(lname, dir->d_name);
+        char shim_path[PATH_MAX];
+        char shim_fname[NAME_MAX];
+        if (!realpath(spawn_path, shim_path) || split_path(shim_path, shim_fname)
+            || 0 == ascii_strcmpi(shim_fname, program_name)) {
+            break;
+        }
+        vlog("shim[%d]: %s", hops, spawn_path);
+        strcpy(path, shim_path);
+        strcpy(fname, shim_fname);
+        if (!(resolved = resolve_target(path, lname, fname))
+            || format_spawn_path(spawn_path, path, lname, fname)) {
+            return 1;
         }
     }
 
-    if (errno) {
-        print_op_error("readdir");
-        closedir(d);
-        return 1;
-    }
-
-    closedir(d);
+#endif
 
-    if (!*lname) {
-        fprintf(stderr, "No version found to run!\n");
-        return 1;
-    }
+#ifndef WINDOWS
 
-    // Build up the path to the program to spawn.
+    // Resolution ends here. Both the journal and the statistics split a
+    // launch at this point: the time to resolve is measured from the start
+    // of the launch and the run time of the target from here, so that the
+    // two add up to the whole launch.
 
-    char spawn_path[PATH_MAX];
-    if (snprintf(spawn_path, DIM(spawn_path), "%s%s%s%s%s", path, PATH_SEPARATOR, lname, PATH_SEPARATOR, fname) >= DIM(spawn_path)) {
-        print_app_error("Final path is too long!");
-        return 1;
+    run_start_ns = clock_ns();
+    if (journal_path) {
+        journal_record_init(&record, fname, path, lname);
+    }
+    if (stats_path && (stats_slot = stats_slot_open(stats_path, path, lname))) {
+        stats_count_launch(stats_slot, resolved, run_start_ns - start_ns);
     }
+#endif
 
     // If the first argument was a template remove it before passing on the
     // rest of arguments to the program to spawn.
@@ -300,6 +789,8 @@ int main(int argc, char **argv)
         }
     }
 
+    trace_phase(PHASE_PATH);
+
     // Shazam!
 
 #ifdef WINDOWS
@@ -318,6 +809,10 @@ int main(int argc, char **argv)
         argv[i] = qarg;
     }
 
+    if (trace) {
+        trace_report();
+    }
+
     intptr_t result = _spawnv(_P_WAIT, spawn_path, argv);
 
     // Free any quoted arguments, including their tracking.
@@ -342,78 +837,2491 @@ int main(int argc, char **argv)
 
 #else // !WINDOWS
 
-    pid_t pid = fork();
+    // In exec mode, the target takes over this process (and its PID) so
+    // there's no parent left waiting around for the life of the child.
+
+    if (exec_mode) {
+        vlog("execv: %s", spawn_path);
+        trace_phase(PHASE_SPAWN);
+        if (trace) {
+            trace_report();
+        }
+        if (journal_path) {
+            record.pid = getpid();
+            journal_append(journal_path, &record);
+        }
+        execv(spawn_path, argv);
+        printf_app_error("Error launching: %s\nReason: %s", spawn_path, strerror(errno));
+        return 1;
+    }
+
+    // Otherwise spawn the target as a child and wait on that very child to
+    // relay its exit code.
+
+    pid_t pid = spawner->spawn(spawn_path, argv);
     if (pid < 0) {
         printf_app_error("Error launching: %s\nReason: %s", spawn_path, strerror(errno));
         return 1;
-    } else if (pid) { // fork parent
-        int status;
-        return wait(&status) >= 0 && WIFEXITED(status)
-             ? WEXITSTATUS(status)
-             : 1;
-    } else { // fork child
-        execv(spawn_path, argv);
-        printf_app_error("Failed to fork: %s\nReason: %s", spawn_path, strerror(errno));
+    }
+
+    trace_phase(PHASE_SPAWN);
+    if (trace) {
+        trace_report();
+    }
+
+    // waitpid on the exact PID is as safe as waiting on a pidfd here: the
+    // child can't be reaped by anyone else, so its PID can't be reused before
+    // this returns. A pidfd would cost two more syscalls (pidfd_open and
+    // close) per launch and would not work on macOS.
+
+    int status;
+    pid_t wpid;
+    while ((wpid = waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+        ;
+
+    if (journal_path) {
+        record.pid = pid;
+        record.status = wpid < 0           ? -1
+                      : WIFEXITED(status)   ? WEXITSTATUS(status)
+                      : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                      : -1;
+        record.wall_ns = clock_ns() - run_start_ns;
+        journal_append(journal_path, &record);
+    }
+
+    if (stats_slot) {
+        stats_count_run(stats_slot, wpid >= 0 && WIFEXITED(status) && !WEXITSTATUS(status));
+    }
+
+    return wpid >= 0 && WIFEXITED(status)
+         ? WEXITSTATUS(status)
+         : 1;
+
+#endif // WINDOWS
+}
+
+// Splits the absolute path of a program in "path" into its directory, left in
+// "path", and its file name without any extension, copied to "fname"
+// (NAME_MAX characters). Returns 0 on success; otherwise an error has been
+// printed and 1 returned.
+
+int split_path(char *path, char *fname)
+{
+    char *pathsep = strrchr(path, PATH_SEPARATOR_CHAR);
+    if (strlen(pathsep + 1) >= NAME_MAX) {
+        printf_app_error("File name is too long: %s", pathsep + 1);
         return 1;
     }
+    strcpy(fname, pathsep + 1);
+    *pathsep = 0;
+
+    // Blow away the file extension, if any.
+
+    char *ext = strrchr(fname, '.');
+    if (ext) {
+        *ext = 0;
+    }
 
     return 0;
+}
 
-#endif // WINDOWS
+// Splits a template of the form `SEARCH_PATH /?/ SUB_PATH` (with `\?\` on
+// Windows) into the search path, copied to "path" (PATH_MAX characters), and
+// the sub-path, copied to "fname" (NAME_MAX characters). Returns 0 on
+// success; otherwise an error has been printed and 1 returned.
+
+int parse_template(char *template, char *path, char *fname)
+{
+    vlog("template: %s", template);
+    const char *sub_path;
+    if (elvee_split_template(template, path, PATH_MAX, &sub_path)) {
+        if (errno == EINVAL) {
+            printf_app_error("Invalid template argument: %s", template);
+        }
+        else {
+            print_app_error("Search path is too long!");
+        }
+        return 1;
+    }
+    if (snprintf(fname, NAME_MAX, "%s", sub_path) >= NAME_MAX) {
+        print_app_error("Trailer path is too long!");
+        return 1;
+    }
+    return 0;
 }
 
-int ascii_strcmpi(char *s1, char *s2)
+// Determines whether the sub-path "fname" has another wildcard and, if so,
+// moves what precedes it to the end of "path", under the version directory
+// "lname", leaving what follows it in "fname". A wildcard can also be the
+// very first segment of "fname". Returns 1 if there was another wildcard, 0
+// if not or -1 if an error has been printed.
+
+int next_level(char *path, char *lname, char *fname)
 {
-    int cmp;
-    for (cmp = 0; 0 == cmp && (*s1 || *s2); s1++, s2++) {
-        cmp = ascii_tolower(*s1) - ascii_tolower(*s2);
+    char token[] = PATH_SEPARATOR "?" PATH_SEPARATOR;
+    char sub_path[NAME_MAX + 1];
+    snprintf(sub_path, DIM(sub_path), "%s%s", PATH_SEPARATOR, fname);
+
+    char *tt = strstr(sub_path, token);
+    if (!tt) {
+        return 0;
     }
-    return cmp;
+    *tt = 0;
+
+    char next_path[PATH_MAX];
+    if (snprintf(next_path, DIM(next_path), "%s%s%s%s", path, PATH_SEPARATOR, lname, sub_path) >= DIM(next_path)) {
+        print_app_error("Search path is too long!");
+        return -1;
+    }
+
+    strcpy(path, next_path);
+    strcpy(fname, tt + DIM(token) - 1);
+    vlog("template: %s%s?%s%s", path, PATH_SEPARATOR, PATH_SEPARATOR, fname);
+    return 1;
 }
 
-void help()
+// Resolves the latest version directory under the search root "path" along
+// with the roots listed in an environment variable named `ELVEE_PATH` or
+// `elvee_path`, updating "path" to the winning root. Returns where the answer
+// came from or SOURCE_NONE if an error has been printed.
+
+enum source resolve_search_path(char *path, char *lname)
 {
-    char *text[] = {
-        PROGRAM_NAME" "PROGRAM_VERSION" - runs latest executable version",
-        "Copyright (c) 2018 Atif Aziz. All rights reserved.",
-        "Licensed under The MIT License: https://opensource.org/licenses/MIT",
-        "",
-        "This program searches for the latest version of an executable and",
-        "runs it, passing along all arguments passed to it. To locate the",
-        "latest version it searches sub-directories that conform to the",
-        "following naming pattern:",
-        "",
-        "  \"v\" MAJOR [ \".\" MINOR [ \".\" PATCH ] ] [ \"-\" SUFFIX ]",
-        "",
-        "MAJOR, MINOR and PATCH must be non-negative decimal integers. The",
-        "SUFFIX is any string of characters starting with a hypen. If",
-        "present, it denotes a pre-release and which is compared ordinally to",
-        "any other pre-release suffix in the same version. Only MAJOR is",
-        "required. Below are examples of sub-directory names following this",
-        "pattern and how they would compare to each other, with the right-most",
-        "being considered the latest:",
-        "",
-        "  v1 < v2 < 3.0 < v3.0.1 < v3.1 < 3.1.1-beta < 3.1.1-rc < 3.1.1",
-        "",
-        "Note that folders named v2 and v2.0 and v2.0.0 will be considered to",
-        "be the same and any one may be chosen arbitrarily if version 2",
-        "represents the latest version so take care to avoid such ambiguities.",
-        "",
-        "Once the latest version directory has been identified, this program",
-        "will run an identically named executable from that directory. It is",
-        "therefore assumed that this program's file name will be renamed to",
-        "bear the same name as the actual target program to run, with this",
-        "program acting as a mere thunk/trampoline/selector.",
-        "",
-        "On a Windows system, the target executable can be a binary with an",
-        "extension of \".com\" or \".exe\", or a batch script with an extension",
-        " of \".bat\" or \".cmd\".",
-        "",
-        "If this program's filename is left exactly \""PROGRAM_NAME"\" then there is a",
-        "second mode of operation where the first required argument specifies",
-        "a template following the syntax (replace / with \\ on Windows):",
-        "",
-        "  SEARCH_PATH \"/?/\" SUB_PATH",
+    char *roots = env_value(PROGRAM_NAME_UPPER "_PATH", PROGRAM_NAME "_path");
+    if (roots && *roots) {
+        char *prefer = env_value(PROGRAM_NAME_UPPER "_PATH_PREFER", PROGRAM_NAME "_path_prefer");
+        int prefer_last = prefer && 0 == strcmp(prefer, "last");
+        if (prefer && *prefer && !prefer_last && strcmp(prefer, "first")) {
+            printf_app_error("Invalid root preference: %s", prefer);
+            return SOURCE_NONE;
+        }
+        return resolve_roots(path, roots, prefer_last, lname);
+    }
+
+    enum source resolved = resolve_version(path, lname);
+    inherit_export(path, lname);
+    return resolved;
+}
+
+// Resolves the latest version directory of the target "fname" under the
+// search root "path" (see resolve_search_path) and then that of each further
+// wildcard in "fname". "path", "lname" and "fname" are updated to the search
+// path, version directory name and sub-path of the last. Returns where the
+// last answer came from or SOURCE_NONE if an error has been printed.
+
+enum source resolve_target(char *path, char *lname, char *fname)
+{
+    enum source resolved = resolve_search_path(path, lname);
+
+    // Resolve any further wildcards in the sub-path, left to right, each
+    // under the version directory found for the one before it.
+
+    int level;
+    while (resolved && *lname && (level = next_level(path, lname, fname))) {
+        if (level < 0) {
+            return SOURCE_NONE;
+        }
+        resolved = resolve_version(path, lname);
+        inherit_export(path, lname);
+    }
+
+    if (resolved && !*lname) {
+        fprintf(stderr, "No version found to run!\n");
+        return SOURCE_NONE;
+    }
+
+    return resolved;
+}
+
+// Formats the path of the program to spawn, "fname" under the version
+// directory "lname" of "path", into "spawn_path" (PATH_MAX characters).
+// Returns 0 on success; otherwise an error has been printed and 1 returned.
+
+int format_spawn_path(char *spawn_path, char *path, char *lname, char *fname)
+{
+    if (snprintf(spawn_path, PATH_MAX, "%s%s%s%s%s", path, PATH_SEPARATOR, lname, PATH_SEPARATOR, fname) >= PATH_MAX) {
+        print_app_error("Final path is too long!");
+        return 1;
+    }
+    return 0;
+}
+
+// Finds the name of the latest version directory under "path" and copies it
+// to "lname", which must hold at least VERSION_NAME_SIZE characters, or
+// leaves it empty if none is found. On *nix, a version published with the
+// "promote" command wins outright, if any. Otherwise the index, the daemon
+// and the resolution cache are consulted in turn, if configured, before
+// scanning. Returns where the answer came from or SOURCE_NONE if an error
+// has been printed.
+
+enum source resolve_version(char *path, char *lname)
+{
+    *lname = 0;
+
+#ifndef WINDOWS
+
+    struct stat dir_stat;
+    char cache_path[PATH_MAX] = { 0 };
+    enum source resolved = SOURCE_NONE;
+
+    // Use the version passed on by the launching process, if any, so that a
+    // whole process tree runs the same version even if a newer one lands
+    // (or is promoted) in the meantime.
+
+    if (inherit_mode && *path == PATH_SEPARATOR_CHAR) {
+        resolved = inherit_lookup(path, lname) ? SOURCE_INHERITED : SOURCE_NONE;
+        vlog("inherited[%s]: %s -> %s", resolved ? "hit" : "miss", path, resolved ? lname : "?");
+    }
+
+    if (!resolved) {
+        resolved = elvee_read_current(path, lname, VERSION_NAME_SIZE) ? SOURCE_CURRENT : SOURCE_NONE;
+        if (resolved) {
+            vlog("current: %s", lname);
+        }
+    }
+
+#ifdef __linux__
+
+    // Look up the index published by the resolver daemon, if one is
+    // configured via an environment variable named `ELVEE_INDEX` or
+    // `elvee_index` set to the path of the index file.
+
+    char *index_path;
+    if (!resolved
+        && (index_path = env_value(PROGRAM_NAME_UPPER "_INDEX", PROGRAM_NAME "_index")) && *index_path
+        && *path == PATH_SEPARATOR_CHAR) {
+        resolved = index_lookup(index_path, path, lname) ? SOURCE_INDEX : SOURCE_NONE;
+        vlog("index[%s]: %s -> %s", resolved ? "hit" : "miss", index_path, resolved ? lname : "?");
+    }
+
+    // Ask the resolver daemon, if one is configured via an environment
+    // variable named `ELVEE_DAEMON` or `elvee_daemon` set to the path of its
+    // socket. Only absolute search paths can be resolved by the daemon since
+    // it doesn't share the current directory of this process.
+
+    char *daemon_socket;
+    if (!resolved
+        && (daemon_socket = env_value(PROGRAM_NAME_UPPER "_DAEMON", PROGRAM_NAME "_daemon")) && *daemon_socket
+        && *path == PATH_SEPARATOR_CHAR) {
+        resolved = daemon_query(daemon_socket, path, lname) ? SOURCE_DAEMON : SOURCE_NONE;
+        vlog("daemon[%s]: %s -> %s", resolved ? "hit" : "miss", daemon_socket, resolved ? lname : "?");
+    }
+
+#endif
+
+    if (!resolved && cache_mode) {
+        if (stat(path, &dir_stat)) {
+            print_op_error("stat");
+            return SOURCE_NONE;
+        }
+        if (cache_entry_path(&dir_stat, cache_path, DIM(cache_path))) {
+            resolved = cache_read(cache_path, &dir_stat, lname) ? SOURCE_CACHE : SOURCE_NONE;
+            vlog("cache[%s]: %s -> %s", resolved ? "hit" : "miss", cache_path, resolved ? lname : "?");
+        }
+    }
+
+    trace_phase(PHASE_LOOKUP);
+
+    if (!resolved) {
+        if (find_latest_version(path, lname)) {
+            return SOURCE_NONE;
+        }
+        resolved = SOURCE_SCAN;
+        if (*cache_path) {
+            cache_write(cache_path, &dir_stat, lname);
+            trace_phase(PHASE_LOOKUP);
+        }
+    }
+
+    return resolved;
+
+#else // WINDOWS
+
+    return find_latest_version(path, lname) ? SOURCE_NONE : SOURCE_SCAN;
+
+#endif
+}
+
+#ifndef WINDOWS
+
+void *resolve_root(void *arg)
+{
+    struct root *root = arg;
+    root->resolved = resolve_version(root->path, root->lname);
+    return NULL;
+}
+
+#endif
+
+// Resolves the latest version under each of the search root "path" and the
+// roots listed in "roots" (separated like PATH), copying the winning root to
+// "path" and the name of its latest version directory to "lname". When
+// roots have the same latest version, the first listed wins unless
+// "prefer_last" is non-zero. Each root beyond the first is resolved on its
+// own thread (*nix only) so that a slow one doesn't hold up the others.
+// Roots that fail to resolve are skipped. Returns where the answer came
+// from or SOURCE_NONE if no root could be resolved.
+
+enum source resolve_roots(char *path, char *roots, int prefer_last, char *lname)
+{
+    struct root *root_list = calloc(MAX_ROOTS, sizeof(*root_list));
+    if (!root_list) {
+        print_op_error("calloc");
+        return SOURCE_NONE;
+    }
+
+    int count = 1;
+    strcpy(root_list[0].path, path);
+
+    for (char *p = roots; *p; ) {
+        char *end = strchr(p, PATH_LIST_SEPARATOR_CHAR);
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len && count == MAX_ROOTS) {
+            printf_app_error("Too many roots (more than %d): %s", MAX_ROOTS - 1, roots);
+            free(root_list);
+            return SOURCE_NONE;
+        }
+        if (len >= PATH_MAX) {
+            printf_app_error("Root path is too long: %.*s", (int)len, p);
+            free(root_list);
+            return SOURCE_NONE;
+        }
+        if (len) {
+            memcpy(root_list[count].path, p, len);
+            root_list[count].path[len] = 0;
+
+            // A root listed twice would only be resolved twice, racing with
+            // itself, so only its first occurrence counts.
+
+            int seen = 0;
+            for (int i = 0; i < count && !seen; i++) {
+                seen = 0 == strcmp(root_list[i].path, root_list[count].path);
+            }
+            count += !seen;
+        }
+        p += len + (end != NULL);
+    }
+
+    // Tracing is suspended while roots are resolved concurrently since
+    // phases can only be timed one after the other. The whole resolution
+    // is then timed as scanning.
+
+    int tracing = trace;
+    trace = 0;
+
+#ifndef WINDOWS
+    pthread_t threads[MAX_ROOTS];
+    int started[MAX_ROOTS] = { 0 };
+    for (int i = 1; i < count; i++) {
+        started[i] = !pthread_create(&threads[i], NULL, resolve_root, &root_list[i]);
+        if (!started[i]) {
+            vlog("pthread_create: %s (resolving inline)", root_list[i].path);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (!started[i]) {
+            resolve_root(&root_list[i]);
+        }
+    }
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        root_list[i].resolved = resolve_version(root_list[i].path, root_list[i].lname);
+    }
+#endif
+
+    trace = tracing;
+    trace_phase(PHASE_SCAN);
+
+    struct root *best = NULL;
+    struct elvee_version best_version;
+    for (int i = 0; i < count; i++) {
+        struct root *root = &root_list[i];
+        struct elvee_version version;
+        vlog("root[%d]: %s -> %s (%s)", i, root->path, *root->lname ? root->lname : "?", source_names[root->resolved]);
+        inherit_export(root->path, root->lname);
+        if (!root->resolved || !*root->lname || !elvee_parse_version(root->lname, &version))
+            continue;
+        if (!best
+            || elvee_version_gt(&version, &best_version)
+            || (prefer_last && !elvee_version_gt(&best_version, &version))) {
+            best = root;
+            best_version = version;
+        }
+    }
+
+    enum source resolved = best ? best->resolved : SOURCE_NONE;
+    if (best) {
+        strcpy(path, best->path);
+        strcpy(lname, best->lname);
+    }
+    else {
+        // No version found anywhere is only an error if every root failed.
+
+        *lname = 0;
+        for (int i = 0; i < count && !resolved; i++) {
+            resolved = root_list[i].resolved;
+        }
+    }
+
+    free(root_list);
+    return resolved;
+}
+
+// Implements the "resolve" command, which reads templates from STDIN, one per
+// line (or NUL-terminated with -0), and prints the path of the program that
+// each resolves to, with the search path made absolute, in the same order and
+// terminated the same way:
+//
+//     resolve [ -0 ]
+//
+// Nothing is spawned and each distinct search path is resolved only once. A
+// template that cannot be resolved prints an empty path (so that results
+// still line up with templates) and an error to STDERR. Returns the program
+// exit code.
+
+struct resolve_entry {
+    char *path;
+    int rooted;     // whether resolved along with the roots of ELVEE_PATH
+    char *abs_path; // of the winning root or NULL if unresolved
+    char lname[VERSION_NAME_SIZE];
+};
+
+int resolve(int argc, char **argv)
+{
+    int terminator = '\n';
+    for (int i = 0; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-0")) {
+            terminator = 0;
+        }
+        else {
+            printf_app_error("Invalid argument: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    struct resolve_entry *entries = NULL;
+    int count = 0;
+    int failed = 0;
+
+    char template[PATH_MAX];
+    char path[PATH_MAX];
+    char fname[NAME_MAX];
+    size_t len = 0;
+    int overflow = 0;
+    int ch;
+
+    do {
+        ch = getchar();
+        if (ch != EOF && ch != terminator) {
+            if (len < DIM(template) - 1) {
+                template[len++] = ch;
+            }
+            else {
+                overflow = 1;
+            }
+            continue;
+        }
+        if (ch == EOF && !len && !overflow)
+            break;
+
+        template[len] = 0;
+        len = 0;
+
+        struct resolve_entry *entry = NULL;
+        if (overflow) {
+            print_app_error("Template is too long!");
+            overflow = 0;
+        }
+        else if (!parse_template(template, path, fname)) {
+            // Resolve the search path of each wildcard in turn, left to right,
+            // the first along with any roots, exactly like a launch.
+
+            for (int rooted = 1; ; rooted = 0) {
+                entry = NULL;
+                for (int i = 0; i < count && !entry; i++) {
+                    if (entries[i].rooted == rooted && 0 == strcmp(entries[i].path, path)) {
+                        entry = &entries[i];
+                    }
+                }
+                if (!entry) {
+                    struct resolve_entry *grown = realloc(entries, (count + 1) * sizeof(*grown));
+                    if (!grown) {
+                        print_op_error("realloc");
+                        return 1;
+                    }
+                    entries = grown;
+                    entry = &grown[count];
+                    entry->rooted = rooted;
+                    entry->abs_path = NULL;
+                    if (!(entry->path = strdup(path))) {
+                        print_op_error("strdup");
+                        return 1;
+                    }
+                    count++;
+
+                    char abs_path[PATH_MAX];
+                    if (rooted ? resolve_search_path(path, entry->lname) : resolve_version(path, entry->lname)) {
+                        if (!*entry->lname) {
+                            printf_app_error("No version found under: %s", path);
+                        }
+                        else if (!realpath(path, abs_path)) {
+                            print_op_error("realpath");
+                        }
+                        else if (!(entry->abs_path = strdup(abs_path))) {
+                            print_op_error("strdup");
+                            return 1;
+                        }
+                    }
+                }
+                if (!entry->abs_path)
+                    break;
+                strcpy(path, entry->abs_path);
+                int level = next_level(path, entry->lname, fname);
+                if (level < 0) {
+                    entry = NULL;
+                }
+                if (level <= 0)
+                    break;
+            }
+        }
+
+        if (entry && entry->abs_path) {
+            printf("%s%s%s%s%s", entry->abs_path, PATH_SEPARATOR, entry->lname, PATH_SEPARATOR, fname);
+        }
+        else {
+            failed = 1;
+        }
+        putchar(terminator);
+    }
+    while (ch != EOF);
+
+    for (int i = 0; i < count; i++) {
+        free(entries[i].path);
+        free(entries[i].abs_path);
+    }
+    free(entries);
+
+    if (fflush(stdout)) {
+        print_op_error("fflush");
+        return 1;
+    }
+
+    return failed;
+}
+
+#ifndef WINDOWS
+
+// Implements the "env" command, which resolves a template to a directory
+// (typically the "bin" directory of the latest version) once and prints shell
+// code that puts that directory at the front of PATH for the shell that
+// evaluates it:
+//
+//     env [ -p ] TEMPLATE
+//
+// The directory activated last for the same template is taken out of PATH
+// again, and remembered for next time in an environment variable named
+// `ELVEE_ENV_` followed by the hash of the (absolute) template. With -p, a reference
+// file under the cache directory gets the modification time of the search
+// path and the code also installs a bash PROMPT_COMMAND hook that evaluates
+// the command again only when the search path is no longer as old as that
+// file, which the shell's own test builtin can tell without running anything.
+// "self_path" is the path of this program, for the hook to run. Returns the
+// program exit code.
+
+int activate(int argc, char **argv, char *self_path)
+{
+    int prompt = 0;
+    char *template = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-p")) {
+            prompt = 1;
+        }
+        else if (!template && *argv[i] != '-') {
+            template = argv[i];
+        }
+        else {
+            printf_app_error("Invalid argument: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    if (!template) {
+        print_app_error("Missing template argument.");
+        return 1;
+    }
+
+    char path[PATH_MAX];
+    char fname[NAME_MAX];
+    char root_path[PATH_MAX];
+    char lname[VERSION_NAME_SIZE];
+    char dir_path[PATH_MAX];
+    char abs_dir_path[PATH_MAX];
+
+    if (parse_template(template, path, fname)) {
+        return 1;
+    }
+
+    // The template is made absolute so that the hook works from any current
+    // directory.
+
+    char abs_template[PATH_MAX];
+    if (!realpath(path, root_path)) {
+        printf_app_error("Error resolving: %s\nReason: %s", path, strerror(errno));
+        return 1;
+    }
+    if (snprintf(abs_template, DIM(abs_template), "%s%s?%s%s", root_path, PATH_SEPARATOR, PATH_SEPARATOR, fname) >= DIM(abs_template)) {
+        print_app_error("Template is too long!");
+        return 1;
+    }
+
+    if (!resolve_target(path, lname, fname) || format_spawn_path(dir_path, path, lname, fname)) {
+        return 1;
+    }
+
+    if (!realpath(dir_path, abs_dir_path)) {
+        printf_app_error("Error resolving: %s\nReason: %s", dir_path, strerror(errno));
+        return 1;
+    }
+
+    unsigned int hash = elvee_string_hash(abs_template, ELVEE_FNV_OFFSET_BASIS);
+    char var_name[32];
+    snprintf(var_name, DIM(var_name), PROGRAM_NAME_UPPER "_ENV_%08X", hash);
+
+    // Record the modification time of the search path as that of the
+    // reference file for the hook to compare against.
+
+    char ref_path[PATH_MAX];
+    if (prompt) {
+        struct stat st;
+        struct timespec times[2];
+        int fd = -1;
+        if (!cache_dir_path(ref_path, DIM(ref_path))) {
+            print_app_error("Cache directory is unknown (neither XDG_CACHE_HOME nor HOME is defined).");
+            return 1;
+        }
+        cache_dir_create(ref_path);
+        size_t len = strlen(ref_path);
+        if (snprintf(ref_path + len, DIM(ref_path) - len, "%senv-%08X", PATH_SEPARATOR, hash) >= DIM(ref_path) - len
+            || stat(root_path, &st)
+            || (fd = open(ref_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) < 0
+            || (times[0].tv_nsec = UTIME_OMIT, times[1] = st.st_mtim, futimens(fd, times))) {
+            printf_app_error("Error recording modification time: %s\nReason: %s", ref_path, strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return 1;
+        }
+        close(fd);
+        vlog("env: %s (mtime %lld.%09ld)", ref_path, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    }
+
+    // Rebuild PATH with the directory at the front and without any other
+    // occurrence of it or of the one activated before.
+
+    char *last_dir_path = getenv(var_name);
+    char *old_path = getenv("PATH");
+    if (old_path && !*old_path) {
+        old_path = NULL; // rather than an empty entry, which means the current directory
+    }
+
+    char *new_path = malloc(strlen(abs_dir_path) + (old_path ? strlen(old_path) : 0) + 2);
+    if (!new_path) {
+        print_op_error("malloc");
+        return 1;
+    }
+
+    char *q = new_path + strlen(strcpy(new_path, abs_dir_path));
+    for (char *p = old_path; p; ) {
+        char *end = strchr(p, PATH_LIST_SEPARATOR_CHAR);
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (!(len == strlen(abs_dir_path) && 0 == strncmp(p, abs_dir_path, len))
+            && !(last_dir_path && len == strlen(last_dir_path) && 0 == strncmp(p, last_dir_path, len))) {
+            *q++ = PATH_LIST_SEPARATOR_CHAR;
+            memcpy(q, p, len);
+            q += len;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    *q = 0;
+
+    printf("PATH=");
+    print_sh_quoted(new_path);
+    printf("; export PATH\n");
+    free(new_path);
+
+    printf("%s=", var_name);
+    print_sh_quoted(abs_dir_path);
+    printf("; export %s\n", var_name);
+
+    if (prompt) {
+        printf("_%s_env_%08X() {\n", PROGRAM_NAME, hash);
+        printf("    if [ ");
+        print_sh_quoted(root_path);
+        printf(" -nt ");
+        print_sh_quoted(ref_path);
+        printf(" ] || [ ");
+        print_sh_quoted(ref_path);
+        printf(" -nt ");
+        print_sh_quoted(root_path);
+        printf(" ]; then\n");
+        printf("        eval \"$(");
+        print_sh_quoted(self_path);
+        printf(" env -p ");
+        print_sh_quoted(abs_template);
+        printf(")\"\n");
+        printf("    fi\n");
+        printf("}\n");
+        printf("case \";${PROMPT_COMMAND-};\" in\n");
+        printf("*\";_%s_env_%08X;\"*) ;;\n", PROGRAM_NAME, hash);
+        printf("*) PROMPT_COMMAND=\"_%s_env_%08X${PROMPT_COMMAND:+;$PROMPT_COMMAND}\" ;;\n", PROGRAM_NAME, hash);
+        printf("esac\n");
+    }
+
+    if (fflush(stdout)) {
+        print_op_error("fflush");
+        return 1;
+    }
+
+    return 0;
+}
+
+// Prints "s" to STDOUT quoted for a POSIX shell, i.e. in single quotes with
+// any single quote in "s" ending the quotes, escaped and quoted again.
+
+void print_sh_quoted(char *s)
+{
+    putchar('\'');
+    for (; *s; s++) {
+        if (*s == '\'') {
+            fputs("'\\''", stdout);
+        }
+        else {
+            putchar(*s);
+        }
+    }
+    putchar('\'');
+}
+
+#endif
+
+#ifdef __linux__
+
+// Implements the "warm" command, which prepares the page cache for the
+// version that a template resolves to (exactly as a launch would) ahead of
+// its first launches:
+//
+//     warm TEMPLATE
+//
+// Every file under the selected version directory is read ahead into the page
+// cache, while the cached pages of every other version directory under the
+// same search path are dropped, unless a running process uses that directory
+// (see running_paths). What was done is printed to STDOUT. Returns the
+// program exit code.
+
+int warm(int argc, char **argv)
+{
+    if (argc < 1) {
+        print_app_error("Missing template argument.");
+        return 1;
+    }
+    if (argc > 1) {
+        printf_app_error("Invalid argument: %s", argv[1]);
+        return 1;
+    }
+
+    char path[PATH_MAX];
+    char fname[NAME_MAX];
+    char lname[VERSION_NAME_SIZE];
+    char root_path[PATH_MAX];
+    char version_path[PATH_MAX];
+
+    if (parse_template(argv[0], path, fname) || !resolve_target(path, lname, fname)) {
+        return 1;
+    }
+
+    if (!realpath(path, root_path)) {
+        printf_app_error("Error resolving: %s\nReason: %s", path, strerror(errno));
+        return 1;
+    }
+
+    int rfd = open(root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rfd < 0) {
+        printf_app_error("Error opening: %s\nReason: %s", root_path, strerror(errno));
+        return 1;
+    }
+
+    // Read the latest version ahead.
+
+    struct warm_stats warmed = { 0 };
+    int vfd = openat(rfd, lname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (vfd < 0) {
+        printf_app_error("Error opening: %s%s%s\nReason: %s", root_path, PATH_SEPARATOR, lname, strerror(errno));
+        close(rfd);
+        return 1;
+    }
+    warm_walk(vfd, POSIX_FADV_WILLNEED, &warmed);
+    printf("warm: %s%s%s (%llu files, %llu bytes, %llu bytes requested)\n",
+           root_path, PATH_SEPARATOR, lname, warmed.files, warmed.bytes, warmed.changed);
+
+    // Drop the other versions unless running.
+
+    struct warm_stats evicted = { 0 };
+    char **used_paths = NULL;
+    int used_count = running_paths(&used_paths);
+
+    DIR *d = fdopendir(rfd);
+    if (!d) {
+        print_op_error("fdopendir");
+        close(rfd);
+    }
+
+    struct dirent *dir;
+    while (d && (dir = readdir(d)) != NULL) {
+        struct elvee_version version;
+        struct stat st;
+        if (0 == strcmp(dir->d_name, lname)
+            || !elvee_parse_version(dir->d_name, &version)
+            || (*version.suffix && *version.suffix != '-')
+            || fstatat(dirfd(d), dir->d_name, &st, AT_SYMLINK_NOFOLLOW) || !S_ISDIR(st.st_mode)
+            || snprintf(version_path, DIM(version_path), "%s%s%s%s", root_path, PATH_SEPARATOR, dir->d_name, PATH_SEPARATOR) >= DIM(version_path)) {
+            continue;
+        }
+
+        // A path under the version directory or the directory itself (like
+        // a working directory) counts.
+
+        size_t version_len = strlen(version_path) - 1;
+        int running = 0;
+        for (int i = 0; i < used_count && !running; i++) {
+            running = 0 == strncmp(used_paths[i], version_path, version_len)
+                   && (!used_paths[i][version_len] || used_paths[i][version_len] == '/');
+        }
+        if (running) {
+            printf("keep: %s%s%s (running)\n", root_path, PATH_SEPARATOR, dir->d_name);
+            continue;
+        }
+
+        int fd = openat(dirfd(d), dir->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            vlog("openat: %s (%s)", dir->d_name, strerror(errno));
+            continue;
+        }
+        struct warm_stats stats = { 0 };
+        warm_walk(fd, POSIX_FADV_DONTNEED, &stats);
+        printf("evict: %s%s%s (%llu files, %llu bytes, %llu bytes dropped)\n",
+               root_path, PATH_SEPARATOR, dir->d_name, stats.files, stats.bytes, stats.changed);
+        evicted.files += stats.files;
+        evicted.bytes += stats.bytes;
+        evicted.changed += stats.changed;
+    }
+
+    if (d) {
+        closedir(d);
+    }
+    for (int i = 0; i < used_count; i++) {
+        free(used_paths[i]);
+    }
+    free(used_paths);
+
+    printf("requested %llu bytes, evicted %llu bytes\n", warmed.changed, evicted.changed);
+
+    if (fflush(stdout)) {
+        print_op_error("fflush");
+        return 1;
+    }
+
+    return 0;
+}
+
+// Applies the page cache "advice" (POSIX_FADV_WILLNEED or
+// POSIX_FADV_DONTNEED) to every regular file under the directory "dfd",
+// which is closed, recursively but without following symbolic links. The
+// files and bytes seen are added to "stats" along with the bytes that were
+// not resident beforehand (when reading ahead, as requested of the kernel,
+// which reads them asynchronously) or that were dropped.
+
+void warm_walk(int dfd, int advice, struct warm_stats *stats)
+{
+    DIR *d = fdopendir(dfd);
+    if (!d) {
+        close(dfd);
+        return;
+    }
+
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        if (0 == strcmp(dir->d_name, ".") || 0 == strcmp(dir->d_name, "..")) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(d), dir->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            int fd = openat(dirfd(d), dir->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd >= 0) {
+                warm_walk(fd, advice, stats);
+            }
+            continue;
+        }
+
+        if (!S_ISREG(st.st_mode) || !st.st_size) {
+            continue;
+        }
+
+        int fd = openat(dirfd(d), dir->d_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            vlog("openat: %s (%s)", dir->d_name, strerror(errno));
+            continue;
+        }
+
+        unsigned long long resident = resident_bytes(fd, st.st_size);
+        int err = posix_fadvise(fd, 0, 0, advice);
+        if (err) {
+            vlog("posix_fadvise: %s (%s)", dir->d_name, strerror(err));
+        }
+        else if (advice == POSIX_FADV_WILLNEED) {
+            stats->changed += st.st_size - resident;
+        }
+        else {
+            unsigned long long left = resident_bytes(fd, st.st_size);
+            stats->changed += resident > left ? resident - left : 0;
+        }
+        stats->files++;
+        stats->bytes += st.st_size;
+        close(fd);
+    }
+
+    closedir(d);
+}
+
+// Counts the bytes of the file "fd" of "size" bytes that are resident in the
+// page cache, in whole pages except for the last.
+
+unsigned long long resident_bytes(int fd, off_t size)
+{
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t pages = (size + page_size - 1) / page_size;
+    unsigned char *vec = malloc(pages);
+    unsigned long long bytes = 0;
+    if (vec && !mincore(map, size, vec)) {
+        for (size_t i = 0; i < pages; i++) {
+            if (vec[i] & 1) {
+                bytes += i < pages - 1 ? page_size : size - (off_t)i * page_size;
+            }
+        }
+    }
+
+    free(vec);
+    munmap(map, size);
+    return bytes;
+}
+
+// Collects the paths that the running processes use (as far as this process
+// is allowed to see them) into a new array stored in "paths", which the caller
+// frees along with each path. A process uses its executable, its working
+// directory, the files it has open (like a script being run by an
+// interpreter) and the files it has mapped (like shared libraries). Returns
+// the number of distinct paths.
+
+int running_paths(char ***paths)
+{
+    int count = 0;
+    DIR *d = opendir("/proc");
+    if (!d) {
+        print_op_error("opendir");
+        return 0;
+    }
+
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        if (dir->d_name[0] < '1' || dir->d_name[0] > '9') {
+            continue;
+        }
+
+        char proc_path[sizeof("/proc//fd/") + 2 * NAME_MAX];
+        char path[PATH_MAX];
+        char *links[] = { "exe", "cwd" };
+        for (int i = 0; i < DIM(links); i++) {
+            snprintf(proc_path, DIM(proc_path), "/proc/%s/%s", dir->d_name, links[i]);
+            ssize_t len = readlink(proc_path, path, DIM(path) - 1);
+            if (len > 0) { // else kernel thread, gone or not ours to see
+                path[len] = 0;
+                count = add_running_path(paths, count, path);
+            }
+        }
+
+        snprintf(proc_path, DIM(proc_path), "/proc/%s/fd", dir->d_name);
+        DIR *fd_dir = opendir(proc_path);
+        struct dirent *fd_entry;
+        while (fd_dir && (fd_entry = readdir(fd_dir)) != NULL) {
+            if (fd_entry->d_name[0] < '0' || fd_entry->d_name[0] > '9') {
+                continue;
+            }
+            ssize_t len = readlinkat(dirfd(fd_dir), fd_entry->d_name, path, DIM(path) - 1);
+            if (len > 0) {
+                path[len] = 0;
+                count = add_running_path(paths, count, path);
+            }
+        }
+        if (fd_dir) {
+            closedir(fd_dir);
+        }
+
+        // The path of a mapped file is the last field of its line and the
+        // only one to start with a slash. Consecutive mappings of the same
+        // file are common so those are only added once.
+
+        snprintf(proc_path, DIM(proc_path), "/proc/%s/maps", dir->d_name);
+        FILE *maps = fopen(proc_path, "re");
+        char line[PATH_MAX + 128];
+        char last[PATH_MAX] = "";
+        while (maps && fgets(line, DIM(line), maps)) {
+            char *map_path = strchr(line, '/');
+            if (!map_path) {
+                continue;
+            }
+            map_path[strcspn(map_path, "\n")] = 0;
+            if (strcmp(map_path, last)) {
+                strncpy(last, map_path, DIM(last) - 1);
+                count = add_running_path(paths, count, map_path);
+            }
+        }
+        if (maps) {
+            fclose(maps);
+        }
+    }
+
+    closedir(d);
+
+    // Sort the paths to drop the duplicates among processes.
+
+    if (count) {
+        qsort(*paths, count, sizeof((*paths)[0]), compare_paths);
+        int distinct = 1;
+        for (int i = 1; i < count; i++) {
+            if (strcmp((*paths)[i], (*paths)[distinct - 1])) {
+                (*paths)[distinct++] = (*paths)[i];
+            }
+            else {
+                free((*paths)[i]);
+            }
+        }
+        count = distinct;
+    }
+
+    return count;
+}
+
+// Appends a copy of "path" to the array "paths" of "count" paths unless it
+// is not absolute (like a socket or pipe). Returns the new count.
+
+int add_running_path(char ***paths, int count, char *path)
+{
+    if (*path != '/') {
+        return count;
+    }
+
+    char **grown = realloc(*paths, (count + 1) * sizeof(grown[0]));
+    if (!grown) {
+        return count;
+    }
+    *paths = grown;
+    if ((grown[count] = strdup(path))) {
+        count++;
+    }
+    return count;
+}
+
+int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+#endif
+
+// Observe the scans of find_latest_version (see struct elvee_scan) to trace
+// them and log them in verbose mode.
+
+void scan_opened(struct elvee_scan *scan, const char *path)
+{
+    trace_phase(PHASE_OPENDIR);
+}
+
+void scan_entry(struct elvee_scan *scan, const char *name, int type,
+                const struct elvee_version *version, int upgrade)
+{
+    vlog("dir[%s]: (%x) %s", version ? " " : "x", type, name);
+    if (version) {
+        vlog("version: %u.%u.%u%s%s", version->major, version->minor, version->patch, version->suffix, upgrade ? " (upgrade)" : "");
+    }
+}
+
+// Scans the directory "path" for the latest version directory (see
+// elvee_find_latest), logging each entry in verbose mode and counting them.
+//
+// The name of the latest version directory is copied to "lname", which must
+// hold at least VERSION_NAME_SIZE characters, or left empty if none is found.
+// Returns 0 on success; otherwise an error has been printed and 1 returned.
+
+int find_latest_version(char *path, char *lname)
+{
+    vlog("opendir: %s", path);
+
+    struct elvee_scan scan = { scan_opened, verbose ? scan_entry : NULL, 0 };
+    int failed = elvee_find_latest(path, lname, VERSION_NAME_SIZE, &scan);
+#ifdef WINDOWS
+    entries_scanned += scan.entries;
+#else
+    __atomic_fetch_add(&entries_scanned, scan.entries, __ATOMIC_RELAXED);
+#endif
+    if (failed) {
+        printf_app_error("Error scanning: %s\nReason: %s", path, strerror(errno));
+        return 1;
+    }
+
+    trace_phase(PHASE_SCAN);
+    return 0;
+}
+
+#ifdef __linux__
+
+// Determines whether the program at "path" is a shim that resolves its target
+// by the same rules as this one, by looking for the note that marks it among
+// the notes of an ELF binary of the same class. Anything that can't be read
+// or isn't such a binary isn't a shim.
+
+int is_shim(char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int shim = 0;
+    ElfW(Ehdr) ehdr;
+    ElfW(Phdr) phdrs[16];
+
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr)
+        && 0 == memcmp(ehdr.e_ident, ELFMAG, SELFMAG)
+        && ehdr.e_ident[EI_CLASS] == (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32)
+        && ehdr.e_phentsize == sizeof(phdrs[0])) {
+
+        size_t phnum = min(ehdr.e_phnum, DIM(phdrs));
+        ssize_t phsize = phnum * sizeof(phdrs[0]);
+        if (pread(fd, phdrs, phsize, ehdr.e_phoff) != phsize) {
+            phnum = 0;
+        }
+
+        for (size_t i = 0; i < phnum && !shim; i++) {
+            char notes[1024];
+            ElfW(Phdr) *phdr = &phdrs[i];
+            if (phdr->p_type != PT_NOTE || phdr->p_filesz > sizeof(notes)
+                || pread(fd, notes, phdr->p_filesz, phdr->p_offset) != (ssize_t)phdr->p_filesz) {
+                continue;
+            }
+
+            // Names and descriptors are each padded to the alignment of the
+            // segment, which is 4 bytes unless 8.
+
+            size_t align = phdr->p_align == 8 ? 8 : 4;
+            for (size_t offset = 0; !shim && offset + sizeof(ElfW(Nhdr)) <= phdr->p_filesz; ) {
+                ElfW(Nhdr) nhdr;
+                memcpy(&nhdr, notes + offset, sizeof(nhdr));
+                size_t name_offset = offset + sizeof(nhdr);
+                size_t desc_offset = name_offset + ((nhdr.n_namesz + align - 1) & ~(align - 1));
+                offset = desc_offset + ((nhdr.n_descsz + align - 1) & ~(align - 1));
+                if (offset > phdr->p_filesz) {
+                    break;
+                }
+                unsigned int revision;
+                shim = nhdr.n_type == SHIM_NOTE_TYPE
+                    && nhdr.n_namesz == sizeof(SHIM_NOTE_NAME)
+                    && 0 == memcmp(notes + name_offset, SHIM_NOTE_NAME, sizeof(SHIM_NOTE_NAME))
+                    && nhdr.n_descsz == sizeof(revision)
+                    && (memcpy(&revision, notes + desc_offset, sizeof(revision)), revision == SHIM_NOTE_REVISION);
+            }
+        }
+    }
+
+    close(fd);
+    return shim;
+}
+
+#endif
+
+int ascii_strcmpi(char *s1, char *s2)
+{
+    int cmp;
+    for (cmp = 0; 0 == cmp && (*s1 || *s2); s1++, s2++) {
+        cmp = ascii_tolower(*s1) - ascii_tolower(*s2);
+    }
+    return cmp;
+}
+
+#ifndef WINDOWS
+
+// Uses posix_spawn, which C libraries like glibc and musl implement with a
+// vfork-style clone that shares the address space until the exec, making it
+// cheaper than a fork that has to copy page tables.
+
+pid_t spawn_posix(char *path, char **argv)
+{
+    pid_t pid;
+    int err = posix_spawn(&pid, path, NULL, NULL, argv, environ);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t spawn_fork(char *path, char **argv)
+{
+    pid_t pid = fork();
+    if (!pid) { // fork child
+        execv(path, argv);
+        printf_app_error("Failed to fork: %s\nReason: %s", path, strerror(errno));
+        _exit(1);
+    }
+    return pid;
+}
+
+// Publishes the latest version directory under the search directory "path"
+// by (re)pointing its "current" symbolic link to it. The link is created
+// under a temporary name and renamed over any existing one so that it is
+// replaced atomically. Returns the program exit code.
+
+int promote(char *path)
+{
+    char lname[VERSION_NAME_SIZE];
+    if (find_latest_version(path, lname)) {
+        return 1;
+    }
+
+    if (!*lname) {
+        fprintf(stderr, "No version found to promote!\n");
+        return 1;
+    }
+
+    int dfd = open(path, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) {
+        print_op_error("open");
+        return 1;
+    }
+
+    char temp_name[NAME_MAX];
+    snprintf(temp_name, DIM(temp_name), "." CURRENT_LINK_NAME ".%ld", (long)getpid());
+
+    if (symlinkat(lname, dfd, temp_name)) {
+        print_op_error("symlinkat");
+        close(dfd);
+        return 1;
+    }
+
+    if (renameat(dfd, temp_name, dfd, CURRENT_LINK_NAME)) {
+        print_op_error("renameat");
+        unlinkat(dfd, temp_name, 0);
+        close(dfd);
+        return 1;
+    }
+
+    close(dfd);
+    printf("%s%s%s -> %s\n", path, PATH_SEPARATOR, CURRENT_LINK_NAME, lname);
+    return 0;
+}
+
+#ifdef __linux__
+
+// Scans the search directory of "entry" (watching it first so no change made
+// during the scan goes unnoticed) and publishes the result to the index, if
+// any. Returns 0 on success or 1 if the scan failed.
+
+int daemon_refresh(struct daemon *daemon, struct daemon_entry *entry)
+{
+    if (entry->wd == -1) {
+        entry->wd = inotify_add_watch(daemon->ifd, entry->path,
+                                      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                      | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    }
+
+    int failed = find_latest_version(entry->path, entry->lname);
+    entry->valid = !failed && entry->wd != -1;
+    if (daemon->index) {
+        index_publish(daemon->index, entry->path, entry->lname, entry->valid);
+    }
+    return failed;
+}
+
+// Reads all pending inotify events without blocking and forgets the answers
+// for the search directories they concern. Search directories that are still
+// watched are rescanned right away if an index is being published so that it
+// stays current.
+
+void daemon_drain_events(struct daemon *daemon)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int changed = 0;
+
+    while ((len = read(daemon->ifd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            vlog("inotify: wd=%d mask=%x %s", event->wd, event->mask, event->len ? event->name : "");
+            for (int i = 0; i < daemon->count; i++) {
+                struct daemon_entry *entry = &daemon->entries[i];
+                if ((event->mask & IN_Q_OVERFLOW) || entry->wd == event->wd) {
+                    entry->valid = 0;
+                    if (event->mask & IN_IGNORED) {
+                        entry->wd = -1;
+                    }
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    if (!changed || !daemon->index)
+        return;
+
+    for (int i = 0; i < daemon->count; i++) {
+        struct daemon_entry *entry = &daemon->entries[i];
+        if (entry->valid)
+            continue;
+        if (entry->wd != -1) {
+            daemon_refresh(daemon, entry);
+        }
+        else {
+            index_publish(daemon->index, entry->path, "", 0);
+        }
+    }
+}
+
+// Answers a single query from the client connected on "cfd".
+
+void daemon_serve(struct daemon *daemon, int cfd)
+{
+    char request[PATH_MAX + 1];
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(request) && (n = recv(cfd, request + len, sizeof(request) - len, 0)) > 0) {
+        len += n;
+        if (memchr(request + len - n, '\n', n))
+            break;
+    }
+
+    char *nl = memchr(request, '\n', len);
+    if (!nl || *request != PATH_SEPARATOR_CHAR) {
+        send(cfd, "!\n", 2, MSG_NOSIGNAL);
+        return;
+    }
+    *nl = 0;
+
+    // Catch up on changes before answering from memory.
+
+    daemon_drain_events(daemon);
+
+    struct daemon_entry *entry = NULL;
+    for (int i = 0; i < daemon->count && !entry; i++) {
+        if (0 == strcmp(daemon->entries[i].path, request)) {
+            entry = &daemon->entries[i];
+        }
+    }
+
+    if (!entry && daemon->count < DAEMON_MAX_ENTRIES) {
+        struct daemon_entry *grown = realloc(daemon->entries, (daemon->count + 1) * sizeof(*grown));
+        if (grown) {
+            daemon->entries = grown;
+            entry = &grown[daemon->count];
+            if ((entry->path = strdup(request))) {
+                entry->wd = -1;
+                entry->valid = 0;
+                daemon->count++;
+            }
+            else {
+                entry = NULL;
+            }
+        }
+    }
+
+    char lname[VERSION_NAME_SIZE];
+    if (entry) {
+        if (!entry->valid && daemon_refresh(daemon, entry)) {
+            send(cfd, "!\n", 2, MSG_NOSIGNAL);
+            return;
+        }
+        strcpy(lname, entry->lname);
+    }
+    else if (find_latest_version(request, lname)) {
+        send(cfd, "!\n", 2, MSG_NOSIGNAL);
+        return;
+    }
+
+    char response[VERSION_NAME_SIZE + 2];
+    len = snprintf(response, DIM(response), "%c%s\n", *lname ? '+' : '-', lname);
+    send(cfd, response, len, MSG_NOSIGNAL);
+}
+
+// Runs the resolver daemon listening on the Unix socket "socket_path" until
+// killed, publishing to the index file "index_path" unless it's NULL.
+// Returns the program exit code on failure.
+
+int daemon_run(char *socket_path, char *index_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf_app_error("Socket path is too long: %s", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    struct daemon daemon = { -1, NULL, 0, NULL };
+
+    if (index_path && !(daemon.index = index_create(index_path))) {
+        return 1;
+    }
+
+    if ((daemon.ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        print_op_error("inotify_init1");
+        return 1;
+    }
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        print_op_error("socket");
+        return 1;
+    }
+
+    unlink(socket_path); // stale from a previous run, if any
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr))) {
+        print_op_error("bind");
+        return 1;
+    }
+    if (listen(lfd, SOMAXCONN)) {
+        print_op_error("listen");
+        return 1;
+    }
+
+    vlog("daemon: listening on %s", socket_path);
+
+    struct pollfd fds[] = { { daemon.ifd, POLLIN, 0 }, { lfd, POLLIN, 0 } };
+
+    for (;;) {
+
+        // Wake up at least every second to stamp the index (if any) as
+        // still being kept current.
+
+        if (daemon.index) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            __atomic_store_n(&daemon.index->heartbeat, (long long)now.tv_sec, __ATOMIC_RELEASE);
+        }
+
+        int ready = poll(fds, DIM(fds), daemon.index ? 1000 : -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            print_op_error("poll");
+            return 1;
+        }
+        if (fds[0].revents & POLLIN) {
+            daemon_drain_events(&daemon);
+        }
+        if (fds[1].revents & POLLIN) {
+            int cfd = accept(lfd, NULL, NULL);
+            if (cfd < 0)
+                continue;
+            struct timeval timeout = { 0, DAEMON_TIMEOUT_MSEC * 1000 };
+            setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            daemon_serve(&daemon, cfd);
+            close(cfd);
+        }
+    }
+}
+
+// Creates a fresh index file at "index_path" and maps it for publishing. The
+// file is initialized under a temporary name and then renamed so that readers
+// never map a partial one. Returns NULL (after printing an error) on failure.
+
+struct index *index_create(char *index_path)
+{
+    char temp_path[PATH_MAX];
+    if (snprintf(temp_path, DIM(temp_path), "%s.%ld", index_path, (long)getpid()) >= DIM(temp_path)) {
+        printf_app_error("Index path is too long: %s", index_path);
+        return NULL;
+    }
+
+    int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        print_op_error("open");
+        return NULL;
+    }
+
+    struct index *index = MAP_FAILED;
+    if (ftruncate(fd, sizeof(struct index))
+        || (index = mmap(NULL, sizeof(struct index), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        print_op_error(index == MAP_FAILED ? "mmap" : "ftruncate");
+        close(fd);
+        unlink(temp_path);
+        return NULL;
+    }
+
+    close(fd);
+    memcpy(index->magic, INDEX_MAGIC, sizeof(index->magic));
+
+    if (rename(temp_path, index_path)) {
+        print_op_error("rename");
+        unlink(temp_path);
+        munmap(index, sizeof(struct index));
+        return NULL;
+    }
+
+    return index;
+}
+
+// Publishes "lname" as the latest version under the search directory "path"
+// (or that it's unknown if "valid" is 0). Search paths too long for a slot
+// or beyond the capacity of the index are silently left out, which only means
+// readers fall back to other means of resolution for them.
+
+void index_publish(struct index *index, char *path, char *lname, int valid)
+{
+    if (strlen(path) >= INDEX_PATH_SIZE)
+        return;
+
+    unsigned int hash = elvee_string_hash(path, ELVEE_FNV_OFFSET_BASIS);
+    struct index_slot *slot = NULL;
+    for (int i = 0; i < INDEX_SLOTS && !slot; i++) {
+        struct index_slot *probe = &index->slots[(hash + i) % INDEX_SLOTS];
+        if (!*probe->path || 0 == strcmp(probe->path, path)) {
+            slot = probe;
+        }
+    }
+
+    if (!slot)
+        return;
+
+    unsigned int seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    strcpy(slot->path, path);
+    strcpy(slot->lname, lname);
+    slot->valid = valid;
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+    vlog("index[publish]: %s -> %s", path, valid ? lname : "?");
+}
+
+// Looks up the latest version under the absolute search directory "path" in
+// the index file "index_path". Returns 1 with the name in "lname" (empty if
+// no version was found) if the index holds a current answer; otherwise 0, in
+// which case the caller should resolve by other means.
+
+int index_lookup(char *index_path, char *path, char *lname)
+{
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    struct index *index = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size == sizeof(struct index)) {
+        index = mmap(NULL, sizeof(struct index), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (index == MAP_FAILED)
+        return 0;
+
+    // An index no longer stamped by its publisher may be out of date.
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int found = 0;
+
+    if (0 == memcmp(index->magic, INDEX_MAGIC, sizeof(index->magic))
+        && now.tv_sec - __atomic_load_n(&index->heartbeat, __ATOMIC_ACQUIRE) <= INDEX_STALE_SEC) {
+
+        unsigned int hash = elvee_string_hash(path, ELVEE_FNV_OFFSET_BASIS);
+        for (int i = 0; i < INDEX_SLOTS; i++) {
+            struct index_slot *slot = &index->slots[(hash + i) % INDEX_SLOTS];
+            unsigned int seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) // being updated so give up
+                break;
+
+            // The last byte of the strings in a slot is never written so
+            // they are always terminated, even if torn.
+
+            int empty = !*slot->path;
+            int match = !empty && 0 == strcmp(slot->path, path);
+            int valid = slot->valid;
+            char name[VERSION_NAME_SIZE];
+            strcpy(name, slot->lname);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) // torn
+                break;
+
+            if (empty)
+                break;
+
+            if (match) {
+                if (valid) {
+                    strcpy(lname, name);
+                    found = 1;
+                }
+                break;
+            }
+        }
+    }
+
+    munmap(index, sizeof(struct index));
+    return found;
+}
+
+// Queries the resolver daemon listening on the Unix socket "socket_path" for
+// the latest version under the absolute search directory "path". Returns 1
+// if the daemon answered, in which case "lname" holds the latest version name
+// (empty if none was found). Returns 0 if the daemon is absent, didn't
+// answer in time or failed, in which case the caller should scan.
+
+int daemon_query(char *socket_path, char *path, char *lname)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    size_t path_len = strlen(path);
+    if (strlen(socket_path) >= sizeof(addr.sun_path) || path_len >= PATH_MAX) {
+        return 0;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct timeval timeout = { 0, DAEMON_TIMEOUT_MSEC * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char buf[PATH_MAX + 1];
+    memcpy(buf, path, path_len);
+    buf[path_len] = '\n';
+
+    size_t len = 0;
+    ssize_t n;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))
+        || send(fd, buf, path_len + 1, MSG_NOSIGNAL) != path_len + 1) {
+        close(fd);
+        return 0;
+    }
+
+    while (len < VERSION_NAME_SIZE + 1 && (n = recv(fd, buf + len, VERSION_NAME_SIZE + 1 - len, 0)) > 0) {
+        len += n;
+        if (memchr(buf + len - n, '\n', n))
+            break;
+    }
+
+    close(fd);
+
+    char *nl = memchr(buf, '\n', len);
+    if (!nl || (*buf != '+' && *buf != '-')) {
+        return 0;
+    }
+
+    *nl = 0;
+    strcpy(lname, buf + 1);
+    return 1;
+}
+
+#endif
+
+// Initializes a journal record for a launch of "name" from the "version"
+// directory under the search directory "path", resolved as of run_start_ns.
+
+void journal_record_init(struct journal_record *record, char *name, char *path, char *version)
+{
+    memset(record, 0, sizeof(*record));
+    memcpy(record->tag, JOURNAL_TAG, sizeof(record->tag));
+    record->status = -1;
+    record->wall_ns = -1;
+    record->resolve_ns = run_start_ns - start_ns;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->time_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    snprintf(record->name, DIM(record->name), "%s", name);
+    snprintf(record->path, DIM(record->path), "%s", path);
+    snprintf(record->version, DIM(record->version), "%s", version);
+}
+
+// Appends "record" to the journal file at "journal_path" with a single write.
+// Failures are not fatal and only logged.
+
+void journal_append(char *journal_path, struct journal_record *record)
+{
+    int fd = open(journal_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, record, sizeof(*record)) != sizeof(*record)) {
+        vlog("journal[error]: %s (%s)", journal_path, strerror(errno));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// Summary of journal records sharing the same search path, version and name.
+
+struct journal_group {
+    struct journal_record *key;
+    long launches, failures, timed;
+    long long wall_ns_sum, wall_ns_max, resolve_ns_sum;
+};
+
+// Implements the "journal" command, which reads a journal file and either
+// lists its records or summarizes them per search path, version and name:
+//
+//     journal FILE [ -l ] [ name=NAME ] [ path=PATH ] [ version=VERSION ]
+//
+// Only records matching all the given filters are considered. Returns the
+// program exit code.
+
+int journal(int argc, char **argv)
+{
+    if (argc < 1) {
+        print_app_error("Missing journal file argument.");
+        return 1;
+    }
+
+    int list = 0;
+    char *filters[3] = { NULL, NULL, NULL }; // name, path, version
+    char *filter_names[] = { "name=", "path=", "version=" };
+
+    for (int i = 1; i < argc; i++) {
+        int known = 0;
+        if (0 == strcmp(argv[i], "-l")) {
+            list = known = 1;
+        }
+        for (int j = 0; j < DIM(filter_names) && !known; j++) {
+            if (0 == strncmp(argv[i], filter_names[j], strlen(filter_names[j]))) {
+                filters[j] = argv[i] + strlen(filter_names[j]);
+                known = 1;
+            }
+        }
+        if (!known) {
+            printf_app_error("Invalid journal argument: %s", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE *f = fopen(argv[0], "rb");
+    if (!f) {
+        print_op_error("fopen");
+        return 1;
+    }
+
+    struct journal_record record;
+    struct journal_group *groups = NULL;
+    int group_count = 0;
+
+    if (list) {
+        printf("%-20s %7s %6s %12s %10s  %s %s %s\n",
+               "TIME (UTC)", "PID", "STATUS", "WALL_MS", "RESOLVE_US", "PATH", "VERSION", "NAME");
+    }
+
+    while (1 == fread(&record, sizeof(record), 1, f)) {
+        if (memcmp(record.tag, JOURNAL_TAG, sizeof(record.tag))) {
+            print_app_error("Invalid journal record!");
+            fclose(f);
+            return 1;
+        }
+
+        record.name[DIM(record.name) - 1] = 0;
+        record.path[DIM(record.path) - 1] = 0;
+        record.version[DIM(record.version) - 1] = 0;
+
+        if ((filters[0] && strcmp(filters[0], record.name))
+            || (filters[1] && strcmp(filters[1], record.path))
+            || (filters[2] && strcmp(filters[2], record.version))) {
+            continue;
+        }
+
+        if (list) {
+            char time_text[32];
+            time_t time = record.time_ns / 1000000000LL;
+            strftime(time_text, DIM(time_text), "%Y-%m-%dT%H:%M:%S", gmtime(&time));
+            printf("%-20s %7d %6d %12.3f %10.3f  %s %s %s\n",
+                   time_text, record.pid, record.status,
+                   record.wall_ns < 0 ? -1.0 : record.wall_ns / 1e6,
+                   record.resolve_ns / 1e3,
+                   record.path, record.version, record.name);
+            continue;
+        }
+
+        struct journal_group *group = NULL;
+        for (int i = 0; i < group_count && !group; i++) {
+            struct journal_record *key = groups[i].key;
+            if (0 == strcmp(key->path, record.path)
+                && 0 == strcmp(key->version, record.version)
+                && 0 == strcmp(key->name, record.name)) {
+                group = &groups[i];
+            }
+        }
+
+        if (!group) {
+            struct journal_group *grown = realloc(groups, (group_count + 1) * sizeof(*grown));
+            struct journal_record *key = malloc(sizeof(*key));
+            if (!grown || !key) {
+                print_app_error("Out of memory!");
+                fclose(f);
+                return 1;
+            }
+            groups = grown;
+            group = &groups[group_count++];
+            memset(group, 0, sizeof(*group));
+            *key = record;
+            group->key = key;
+        }
+
+        group->launches++;
+        group->resolve_ns_sum += record.resolve_ns;
+        if (record.status > 0) {
+            group->failures++;
+        }
+        if (record.wall_ns >= 0) {
+            group->timed++;
+            group->wall_ns_sum += record.wall_ns;
+            if (record.wall_ns > group->wall_ns_max) {
+                group->wall_ns_max = record.wall_ns;
+            }
+        }
+    }
+
+    fclose(f);
+
+    if (!list) {
+        printf("%8s %8s %12s %12s %10s  %s %s %s\n",
+               "LAUNCHES", "FAILED", "WALL_AVG_MS", "WALL_MAX_MS", "RESOLVE_US", "PATH", "VERSION", "NAME");
+        for (int i = 0; i < group_count; i++) {
+            struct journal_group *group = &groups[i];
+            printf("%8ld %8ld %12.3f %12.3f %10.3f  %s %s %s\n",
+                   group->launches, group->failures,
+                   group->timed ? group->wall_ns_sum / 1e6 / group->timed : -1.0,
+                   group->timed ? group->wall_ns_max / 1e6 : -1.0,
+                   group->resolve_ns_sum / 1e3 / group->launches,
+                   group->key->path, group->key->version, group->key->name);
+            free(group->key);
+        }
+        free(groups);
+    }
+
+    return 0;
+}
+
+// Maps the statistics file at "stats_path", creating it if necessary. Returns
+// NULL if it can't be mapped or isn't a statistics file.
+
+struct stats *stats_map(char *stats_path, int create)
+{
+    int fd = open(stats_path, (create ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        vlog("stats[error]: %s (%s)", stats_path, strerror(errno));
+        return NULL;
+    }
+
+    // A new file is grown to size by whichever launch gets to it first (and
+    // maybe more than one, which is harmless).
+
+    struct stat st;
+    struct stats *stats = MAP_FAILED;
+    if (!fstat(fd, &st)
+        && (st.st_size == sizeof(struct stats)
+            || (create && !st.st_size && !ftruncate(fd, sizeof(struct stats))))) {
+        stats = mmap(NULL, sizeof(struct stats), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (stats == MAP_FAILED) {
+        vlog("stats[error]: %s (not a statistics file)", stats_path);
+        return NULL;
+    }
+
+    if (memcmp(stats->magic, STATS_MAGIC, sizeof(stats->magic))) {
+        int blank = 1;
+        for (int i = 0; i < sizeof(stats->magic) && blank; i++) {
+            blank = !stats->magic[i];
+        }
+        if (!create || !blank) {
+            vlog("stats[error]: %s (not a statistics file)", stats_path);
+            munmap(stats, sizeof(struct stats));
+            return NULL;
+        }
+        memcpy(stats->magic, STATS_MAGIC, sizeof(stats->magic));
+    }
+
+    return stats;
+}
+
+// Returns the slot of the statistics file at "stats_path" that counts the
+// launches of "version" under the search directory "path", claiming one if
+// it's the first such launch. Returns NULL if there's no slot to be had
+// without waiting, in which case the launch goes uncounted. The file remains
+// mapped for the life of this process.
+
+struct stats_slot *stats_slot_open(char *stats_path, char *path, char *version)
+{
+    if (strlen(path) >= STATS_PATH_SIZE)
+        return NULL;
+
+    struct stats *stats = stats_map(stats_path, 1);
+    if (!stats)
+        return NULL;
+
+    unsigned int hash = elvee_string_hash(version, elvee_string_hash(path, ELVEE_FNV_OFFSET_BASIS));
+    for (int i = 0; i < STATS_SLOTS; i++) {
+        struct stats_slot *slot = &stats->slots[(hash + i) % STATS_SLOTS];
+        unsigned int state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state == STATS_EMPTY) {
+            if (__atomic_compare_exchange_n(&slot->state, &state, STATS_CLAIMED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                slot->hash = hash;
+                strcpy(slot->path, path);
+                strcpy(slot->version, version);
+                __atomic_store_n(&slot->state, STATS_READY, __ATOMIC_RELEASE);
+                return slot;
+            }
+            // Lost the race for the slot so look at what it holds now.
+        }
+        if (state == STATS_CLAIMED)
+            return NULL;
+        if (slot->hash == hash && 0 == strcmp(slot->path, path) && 0 == strcmp(slot->version, version))
+            return slot;
+    }
+
+    return NULL;
+}
+
+void stats_histogram_add(struct stats_histogram *histogram, long long ns)
+{
+    unsigned long long us = ns > 0 ? ns / 1000 : 0;
+    int bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && us >> bucket) {
+        bucket++;
+    }
+    __atomic_fetch_add(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_us, us, __ATOMIC_RELAXED);
+}
+
+// Counts a launch resolved from "source" in "resolve_ns" nanoseconds.
+
+void stats_count_launch(struct stats_slot *slot, enum source source, long long resolve_ns)
+{
+    __atomic_fetch_add(&slot->launches, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->resolutions[source], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->entries_scanned, entries_scanned, __ATOMIC_RELAXED);
+    stats_histogram_add(&slot->resolve, resolve_ns);
+}
+
+// Counts a run of the target that just ended, timed from the end of
+// resolution (see run_start_ns) like the journal.
+
+void stats_count_run(struct stats_slot *slot, int succeeded)
+{
+    __atomic_fetch_add(&slot->runs, 1, __ATOMIC_RELAXED);
+    if (!succeeded) {
+        __atomic_fetch_add(&slot->failed_runs, 1, __ATOMIC_RELAXED);
+    }
+    stats_histogram_add(&slot->run, clock_ns() - run_start_ns);
+}
+
+// Copies "s" to "buf", which must hold twice as many characters as "s"
+// (including its terminator), escaped as a label value of the OpenMetrics
+// exposition format: a backslash, a double quote and a line feed become \\,
+// \" and \n, respectively. For a DogStatsD tag value ("tag" set), the comma
+// and the vertical bar, which would end the tag or the datagram and can't be
+// escaped, are also replaced with an underscore.
+
+void stats_escape(char *s, char *buf, int tag)
+{
+    for (; *s; s++) {
+        if (*s == '\\' || *s == '"' || *s == '\n') {
+            *buf++ = '\\';
+            *buf++ = *s == '\n' ? 'n' : *s;
+        }
+        else if (tag && (*s == ',' || *s == '|')) {
+            *buf++ = '_';
+        }
+        else {
+            *buf++ = *s;
+        }
+    }
+    *buf = 0;
+}
+
+// Prints "histogram" named "name" in "format", labelled (for OpenMetrics)
+// with the escaped search path "root" and "version".
+
+void stats_print_histogram(char *format, char *name, char *root, char *version, struct stats_histogram *histogram)
+{
+    unsigned long long count = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        if (!histogram->buckets[i])
+            continue;
+        count += histogram->buckets[i];
+        if (0 == strcmp(format, "openmetrics")) {
+            printf("elvee_%s_seconds_bucket{root=\"%s\",version=\"%s\",le=\"%g\"} %llu\n",
+                   name, root, version, (double)(1ULL << i) / 1e6, count);
+        }
+        else if (0 == strcmp(format, "text")) {
+            printf("  %s < %lluus: %llu\n", name, 1ULL << i, histogram->buckets[i]);
+        }
+    }
+    if (0 == strcmp(format, "openmetrics")) {
+        printf("elvee_%s_seconds_bucket{root=\"%s\",version=\"%s\",le=\"+Inf\"} %llu\n", name, root, version, count);
+        printf("elvee_%s_seconds_count{root=\"%s\",version=\"%s\"} %llu\n", name, root, version, count);
+        printf("elvee_%s_seconds_sum{root=\"%s\",version=\"%s\"} %g\n", name, root, version, histogram->sum_us / 1e6);
+    }
+}
+
+// Sends the counters of "slot" as gauges over the UDP socket "fd" to the
+// StatsD server at "addr", using DogStatsD tags for the (escaped) search
+// path and version.
+
+void stats_push(int fd, struct sockaddr_in *addr, struct stats_slot *slot)
+{
+    struct { char *name; unsigned long long value; } gauges[] = {
+        { "launches"       , slot->launches        },
+        { "entries_scanned", slot->entries_scanned },
+        { "runs"           , slot->runs            },
+        { "failed_runs"    , slot->failed_runs     },
+        { "resolve_us_sum" , slot->resolve.sum_us  },
+        { "run_us_sum"     , slot->run.sum_us      },
+    };
+
+    char root[2 * STATS_PATH_SIZE];
+    char version[2 * VERSION_NAME_SIZE];
+    stats_escape(slot->path, root, 1);
+    stats_escape(slot->version, version, 1);
+
+    char line[2048];
+    for (int i = 0; i < DIM(gauges) + SOURCE_COUNT - 1; i++) {
+        int len = i < DIM(gauges)
+                ? snprintf(line, DIM(line), PROGRAM_NAME ".%s:%llu|g|#root:%s,version:%s",
+                           gauges[i].name, gauges[i].value, root, version)
+                : snprintf(line, DIM(line), PROGRAM_NAME ".resolutions:%llu|g|#root:%s,version:%s,source:%s",
+                           slot->resolutions[i - DIM(gauges) + 1], root, version, source_names[i - DIM(gauges) + 1]);
+        if (len < DIM(line)) {
+            sendto(fd, line, len, 0, (struct sockaddr *)addr, sizeof(*addr));
+        }
+    }
+}
+
+// Implements the "stats" command, which dumps the statistics file as text
+// (the default) or OpenMetrics, or pushes it to a local StatsD server:
+//
+//     stats FILE [ text | openmetrics | statsd [ PORT ] ]
+//
+// Returns the program exit code.
+
+int stats(int argc, char **argv)
+{
+    if (argc < 1) {
+        print_app_error("Missing statistics file argument.");
+        return 1;
+    }
+
+    char *format = argc > 1 ? argv[1] : "text";
+    if (strcmp(format, "text") && strcmp(format, "openmetrics") && strcmp(format, "statsd")) {
+        printf_app_error("Invalid statistics format: %s", format);
+        return 1;
+    }
+
+    struct stats *stats = stats_map(argv[0], 0);
+    if (!stats) {
+        printf_app_error("Invalid statistics file: %s", argv[0]);
+        return 1;
+    }
+
+    int fd = -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    if (0 == strcmp(format, "statsd")) {
+        addr.sin_port = htons(argc > 2 ? atoi(argv[2]) : 8125);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+            print_op_error("socket");
+            return 1;
+        }
+    }
+
+    int openmetrics = 0 == strcmp(format, "openmetrics");
+    char *counters[] = { "launches", "resolutions", "entries_scanned", "runs", "failed_runs" };
+    for (int c = 0; c < (openmetrics ? DIM(counters) : 1); c++) {
+        if (openmetrics) {
+            printf("# TYPE elvee_%s counter\n", counters[c]);
+        }
+        for (int i = 0; i < STATS_SLOTS; i++) {
+            struct stats_slot *slot = &stats->slots[i];
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != STATS_READY)
+                continue;
+            char root[2 * STATS_PATH_SIZE];
+            char version[2 * VERSION_NAME_SIZE];
+            stats_escape(slot->path, root, 0);
+            stats_escape(slot->version, version, 0);
+            if (fd >= 0) {
+                stats_push(fd, &addr, slot);
+            }
+            else if (openmetrics) {
+                unsigned long long values[] = { slot->launches, 0, slot->entries_scanned, slot->runs, slot->failed_runs };
+                if (c == 1) {
+                    for (int s = SOURCE_NONE + 1; s < SOURCE_COUNT; s++) {
+                        printf("elvee_resolutions_total{root=\"%s\",version=\"%s\",source=\"%s\"} %llu\n",
+                               root, version, source_names[s], slot->resolutions[s]);
+                    }
+                }
+                else {
+                    printf("elvee_%s_total{root=\"%s\",version=\"%s\"} %llu\n", counters[c], root, version, values[c]);
+                }
+            }
+            else {
+                printf("%s%s%s\n", slot->path, PATH_SEPARATOR, slot->version);
+                printf("  launches: %llu\n", slot->launches);
+                for (int s = SOURCE_NONE + 1; s < SOURCE_COUNT; s++) {
+                    printf("  resolved by %s: %llu\n", source_names[s], slot->resolutions[s]);
+                }
+                printf("  entries scanned: %llu\n", slot->entries_scanned);
+                printf("  runs: %llu (%llu failed)\n", slot->runs, slot->failed_runs);
+                stats_print_histogram(format, "resolve", root, version, &slot->resolve);
+                stats_print_histogram(format, "run", root, version, &slot->run);
+            }
+        }
+    }
+
+    if (openmetrics) {
+        char *histograms[] = { "resolve", "run" };
+        for (int h = 0; h < DIM(histograms); h++) {
+            printf("# TYPE elvee_%s_seconds histogram\n", histograms[h]);
+            for (int i = 0; i < STATS_SLOTS; i++) {
+                struct stats_slot *slot = &stats->slots[i];
+                if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == STATS_READY) {
+                    char root[2 * STATS_PATH_SIZE];
+                    char version[2 * VERSION_NAME_SIZE];
+                    stats_escape(slot->path, root, 0);
+                    stats_escape(slot->version, version, 0);
+                    stats_print_histogram(format, histograms[h], root, version, h ? &slot->run : &slot->resolve);
+                }
+            }
+        }
+        printf("# EOF\n");
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return 0;
+}
+
+// Copies the version passed on by the launching process for the absolute
+// search path "path" to "lname", provided that it names a version directory
+// that still exists. Returns 1 if it does; otherwise 0 with "lname" left
+// untouched.
+
+int inherit_lookup(char *path, char *lname)
+{
+    char name[32];
+    snprintf(name, DIM(name), INHERIT_PREFIX "%08X", elvee_string_hash(path, ELVEE_FNV_OFFSET_BASIS));
+
+    char *value = getenv(name);
+    struct elvee_version version;
+    char version_path[PATH_MAX];
+    struct stat st;
+
+    if (!value || strlen(value) >= VERSION_NAME_SIZE || strchr(value, PATH_SEPARATOR_CHAR)
+        || !elvee_parse_version(value, &version)
+        || snprintf(version_path, DIM(version_path), "%s%s%s", path, PATH_SEPARATOR, value) >= DIM(version_path)
+        || stat(version_path, &st) || !S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+
+    strcpy(lname, value);
+    return 1;
+}
+
+// Builds the path of the cache directory, "$XDG_CACHE_HOME/elvee" or
+// "$HOME/.cache/elvee", into "buf". Returns 1 on success or 0 if neither
+// variable is defined or the path does not fit.
+
+int cache_dir_path(char *buf, size_t size)
+{
+    char *base;
+    char *tail;
+    if ((base = getenv("XDG_CACHE_HOME")) && *base) {
+        tail = "";
+    }
+    else if ((base = getenv("HOME")) && *base) {
+        tail = PATH_SEPARATOR ".cache";
+    }
+    else {
+        return 0;
+    }
+
+    int len = snprintf(buf, size, "%s%s" PATH_SEPARATOR PROGRAM_NAME, base, tail);
+    return len > 0 && len < size;
+}
+
+// Creates the cache directory "dir_path" and its parent, if necessary.
+
+void cache_dir_create(char *dir_path)
+{
+    if (mkdir(dir_path, 0700) && errno == ENOENT) {
+        char *sep = strrchr(dir_path, PATH_SEPARATOR_CHAR);
+        *sep = 0;
+        mkdir(dir_path, 0700);
+        *sep = PATH_SEPARATOR_CHAR;
+        mkdir(dir_path, 0700);
+    }
+}
+
+// Builds the path of the cache entry file for the search directory described
+// by "st" into "buf". Returns 1 on success or 0 if there is no cache directory
+// or the path does not fit.
+
+int cache_entry_path(struct stat *st, char *buf, size_t size)
+{
+    if (!cache_dir_path(buf, size)) {
+        return 0;
+    }
+
+    size_t dir_len = strlen(buf);
+    int len = snprintf(buf + dir_len, size - dir_len, PATH_SEPARATOR "%llx-%llx",
+                       (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+    return len > 0 && len < size - dir_len;
+}
+
+void cache_entry_init(struct cache_entry *entry, struct stat *st)
+{
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->magic, CACHE_MAGIC, sizeof(entry->magic));
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->mtime_sec  = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->ctime_sec  = st->st_ctim.tv_sec;
+    entry->ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+// Reads the cache entry file at "cache_path" and, if it is still valid for
+// the search directory described by "st", copies the cached version name
+// (possibly empty) to "lname" and returns 1. Otherwise returns 0.
+
+int cache_read(char *cache_path, struct stat *st, char *lname)
+{
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct cache_entry entry, expected;
+    ssize_t read_size = read(fd, &entry, sizeof(entry));
+    close(fd);
+
+    cache_entry_init(&expected, st);
+    if (read_size != sizeof(entry)
+        || memcmp(&entry, &expected, offsetof(struct cache_entry, name))
+        || !memchr(entry.name, 0, sizeof(entry.name))) {
+        return 0;
+    }
+
+    strcpy(lname, entry.name);
+    return 1;
+}
+
+// Writes the cache entry file at "cache_path" recording "lname" as the
+// latest version for the search directory described by "st". The file is
+// written under a temporary name and then renamed so readers never see a
+// partial entry. Failures are not fatal and only logged.
+
+void cache_write(char *cache_path, struct stat *st, char *lname)
+{
+    // Don't trust time stamps that haven't settled yet to validate the entry
+    // (see ELVEE_SETTLE_SECONDS).
+
+    time_t now = time(NULL);
+    if (now - st->st_mtim.tv_sec < ELVEE_SETTLE_SECONDS || now - st->st_ctim.tv_sec < ELVEE_SETTLE_SECONDS) {
+        vlog("cache[skip]: %s (recently modified)", cache_path);
+        return;
+    }
+
+    char dir_path[PATH_MAX];
+    strcpy(dir_path, cache_path);
+    *strrchr(dir_path, PATH_SEPARATOR_CHAR) = 0;
+    cache_dir_create(dir_path);
+
+    struct cache_entry entry;
+    cache_entry_init(&entry, st);
+    strcpy(entry.name, lname);
+
+    // The temporary name is unique to the thread too since roots are
+    // resolved concurrently and two of them can be the same directory
+    // spelled differently, sharing the same entry.
+
+    char temp_path[PATH_MAX];
+    if (snprintf(temp_path, DIM(temp_path), "%s.%ld.%lx", cache_path, (long)getpid(),
+                 (unsigned long)(uintptr_t)pthread_self()) >= DIM(temp_path)) {
+        return;
+    }
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        vlog("cache[error]: %s (%s)", temp_path, strerror(errno));
+        return;
+    }
+
+    int ok = write(fd, &entry, sizeof(entry)) == sizeof(entry);
+    close(fd);
+
+    if (!ok || rename(temp_path, cache_path)) {
+        vlog("cache[error]: %s (%s)", cache_path, strerror(errno));
+        unlink(temp_path);
+        return;
+    }
+
+    vlog("cache[write]: %s -> %s", cache_path, *lname ? lname : "(none)");
+}
+
+#endif
+
+// Returns the current time of a monotonic clock in nanoseconds.
+
+long long clock_ns()
+{
+    struct timespec ts;
+#ifdef WINDOWS
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void trace_end_phase(enum phase phase)
+{
+    long long now = clock_ns();
+    phase_ns[phase] += now - trace_mark_ns;
+    trace_mark_ns = now;
+}
+
+// Writes the durations of the phases so far to STDERR as a single line of
+// space-separated NAME=NANOSECONDS pairs, ending with the total.
+
+void trace_report()
+{
+    char line[512];
+    int len = snprintf(line, DIM(line), PROGRAM_NAME "-trace:");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        len += snprintf(line + len, DIM(line) - len, " %s=%lld", phase_names[i], phase_ns[i]);
+    }
+    snprintf(line + len, DIM(line) - len, " total=%lld\n", trace_mark_ns - start_ns);
+    fputs(line, stderr);
+}
+
+// Returns the value of the first of the named environment variables that is
+// defined; otherwise NULL.
+
+char *env_value(char *name_upper, char *name_lower)
+{
+    char *value;
+    if (!(value = getenv(name_upper))) {
+        value = getenv(name_lower);
+    }
+    return value;
+}
+
+// Passes the version "lname" found under the search path "path" on to the
+// target (*nix only) when inheritance is enabled. Only absolute search paths
+// are passed on since the target needn't share the current directory of
+// this process.
+
+void inherit_export(char *path, char *lname)
+{
+#ifndef WINDOWS
+    if (!inherit_mode || !*lname || *path != PATH_SEPARATOR_CHAR) {
+        return;
+    }
+
+    char name[32];
+    snprintf(name, DIM(name), INHERIT_PREFIX "%08X", elvee_string_hash(path, ELVEE_FNV_OFFSET_BASIS));
+    if (setenv(name, lname, 1)) {
+        vlog("setenv: %s (%s)", name, strerror(errno));
+        return;
+    }
+    vlog("export: %s=%s (%s)", name, lname, path);
+#endif
+}
+
+// Returns 1 if either of the named environment variables is defined and its
+// value is anything but 0; otherwise 0. The first name takes precedence.
+
+int env_flag(char *name_upper, char *name_lower)
+{
+    char *value = env_value(name_upper, name_lower);
+    return value && strcmp("0", value) ? 1 : 0;
+}
+
+void help()
+{
+    char *text[] = {
+        PROGRAM_NAME" "PROGRAM_VERSION" - runs latest executable version",
+        "Copyright (c) 2018 Atif Aziz. All rights reserved.",
+        "Licensed under The MIT License: https://opensource.org/licenses/MIT",
+        "",
+        "This program searches for the latest version of an executable and",
+        "runs it, passing along all arguments passed to it. To locate the",
+        "latest version it searches sub-directories that conform to the",
+        "following naming pattern:",
+        "",
+        "  \"v\" MAJOR [ \".\" MINOR [ \".\" PATCH ] ] [ \"-\" SUFFIX ]",
+        "",
+        "MAJOR, MINOR and PATCH must be non-negative decimal integers. The",
+        "SUFFIX is any string of characters starting with a hypen. If",
+        "present, it denotes a pre-release and which is compared ordinally to",
+        "any other pre-release suffix in the same version. Only MAJOR is",
+        "required. Below are examples of sub-directory names following this",
+        "pattern and how they would compare to each other, with the right-most",
+        "being considered the latest:",
+        "",
+        "  v1 < v2 < 3.0 < v3.0.1 < v3.1 < 3.1.1-beta < 3.1.1-rc < 3.1.1",
+        "",
+        "Note that folders named v2 and v2.0 and v2.0.0 will be considered to",
+        "be the same and any one may be chosen arbitrarily if version 2",
+        "represents the latest version so take care to avoid such ambiguities.",
+        "",
+        "Once the latest version directory has been identified, this program",
+        "will run an identically named executable from that directory. It is",
+        "therefore assumed that this program's file name will be renamed to",
+        "bear the same name as the actual target program to run, with this",
+        "program acting as a mere thunk/trampoline/selector.",
+        "",
+        "On a Windows system, the target executable can be a binary with an",
+        "extension of \".com\" or \".exe\", or a batch script with an extension",
+        " of \".bat\" or \".cmd\".",
+        "",
+        "If this program's filename is left exactly \""PROGRAM_NAME"\" then there is a",
+        "second mode of operation where the first required argument specifies",
+        "a template following the syntax (replace / with \\ on Windows):",
+        "",
+        "  SEARCH_PATH \"/?/\" SUB_PATH",
         "",
         "SEARCH_PATH is a relative or absolute directory path where the latest",
         "version sub-directory will be sought based on the earlier explanation",
@@ -430,10 +3338,140 @@ void help()
         "",
         "  /app/v4.2/bin/foo bar baz",
         "",
+        "SUB_PATH may itself contain further \"/?/\" tokens, which are",
+        "resolved left to right, each under the version directory found for",
+        "the one before it. For example, \"/app/?/plugins/?/bin/tool\" could",
+        "run \"/app/v4.2/plugins/v1.3/bin/tool\".",
+        "",
+        "Run this program with \"resolve\" (without quotes) as the first",
+        "argument to read templates from STDIN, one per line (or",
+        "NUL-terminated with -0), and print the path each resolves to instead",
+        "of running anything:",
+        "",
+        "  "PROGRAM_NAME" resolve [ -0 ]",
+        "",
+        "Each distinct search path is resolved only once. A template that",
+        "cannot be resolved prints an empty path and an error to STDERR.",
+        "",
+        "On a *nix system, run this program with \"env\" (without quotes) as",
+        "the first argument followed by a template of a directory to print",
+        "shell code that puts the directory it resolves to at the front of",
+        "PATH, in place of the one it put there before, if any:",
+        "",
+        "  eval \"$("PROGRAM_NAME" env [ -p ] /app/?/bin)\"",
+        "",
+        "With -p, the code also installs a bash PROMPT_COMMAND hook that",
+        "does this again whenever the modification time of the search path",
+        "changes (e.g. when a new version is added).",
+        "",
+        "On a Linux system, run this program with \"warm\" (without quotes)",
+        "as the first argument followed by a template to read the files of",
+        "the version it resolves to ahead into the page cache and drop those",
+        "of the other versions under the same search path from it, except",
+        "versions that a running process uses (for its executable, working",
+        "directory, open files or mapped files):",
+        "",
+        "  "PROGRAM_NAME" warm /app/?/",
+        "",
         "For dianostics, this program will display verbose output to STDERR",
         "if the environment variable "PROGRAM_NAME_UPPER"_VERBOSE is defined to be any value",
         "but zero (0).",
         "",
+        "To measure its overhead, this program will display a single line on",
+        "STDERR with the time taken by each phase of a launch, in nanoseconds,",
+        "if the environment variable "PROGRAM_NAME_UPPER"_TRACE is defined to be any",
+        "value but zero (0).",
+        "",
+        "On a *nix system, if the environment variable "PROGRAM_NAME_UPPER"_JOURNAL is",
+        "defined to be a file path then this program appends a fixed-size",
+        "record of each launch to that file: when it happened, the search path,",
+        "the version and program run, the time taken to resolve it, the",
+        "process ID as well as the exit code and run time (unless exec'd). Run",
+        "this program with \"journal\" (without quotes) as the first argument",
+        "to read a journal file:",
+        "",
+        "  "PROGRAM_NAME" journal FILE [ -l ] [ name=NAME ] [ path=PATH ] [ version=VERSION ]",
+        "",
+        "It summarizes the records per search path, version and name, or lists",
+        "them with -l. Only records matching all of the given filters count.",
+        "",
+        "On a *nix system, if the environment variable "PROGRAM_NAME_UPPER"_STATS is",
+        "defined to be a file path then this program counts launches per search",
+        "path and version in that file, which is shared by all launches: how",
+        "many, how the version was resolved, how many directory entries were",
+        "scanned, and histograms of the time taken to resolve the version and",
+        "the run time of the target. Run this program with \"stats\" (without",
+        "quotes) as the first argument to read the counters:",
+        "",
+        "  "PROGRAM_NAME" stats FILE [ text | openmetrics | statsd [ PORT ] ]",
+        "",
+        "The counters are displayed as text or in the OpenMetrics format, or sent",
+        "as gauges to a StatsD server listening on the local UDP PORT (8125 by",
+        "default).",
+        "",
+        "On a *nix system, if the environment variable "PROGRAM_NAME_UPPER"_EXEC is",
+        "defined to be any value but zero (0) then this program replaces itself",
+        "with the target program rather than running it as a child process and",
+        "waiting for it to exit. The target then inherits the process ID of",
+        "this program. This variable has no effect on Windows.",
+        "",
+        "Otherwise, on a *nix system, the environment variable",
+        PROGRAM_NAME_UPPER"_SPAWN selects how the target program is spawned as a",
+        "child process. It can be \"posix_spawn\" (the default) or \"fork\".",
+        "",
+        "If the environment variable "PROGRAM_NAME_UPPER"_PATH is defined to be a",
+        "list of directories (separated by : on *nix or ; on Windows) then",
+        "they are searched too, after the search path, for the latest version.",
+        "The roots are searched concurrently on *nix. Of roots with the same",
+        "latest version, the first wins unless "PROGRAM_NAME_UPPER"_PATH_PREFER is",
+        "defined to be \"last\".",
+        "",
+        "On a Linux system, if the environment variable "PROGRAM_NAME_UPPER"_COLLAPSE is",
+        "defined to be any value but zero (0) and the target program is itself",
+        "a copy of this program (under another name) then its target is",
+        "resolved and run directly instead, and so on down a chain of up to 8",
+        "such copies.",
+        "",
+        "On a *nix system, if the environment variable "PROGRAM_NAME_UPPER"_INHERIT is",
+        "defined to be any value but zero (0) then the latest version found in",
+        "each absolute search path is passed on to the target in an environment",
+        "variable named "PROGRAM_NAME_UPPER"_ROOT_ followed by the hash of the search",
+        "path. Launches further down the process tree then use that version,",
+        "as long as its directory still exists, without looking any further.",
+        "",
+        "On a *nix system, if the environment variable "PROGRAM_NAME_UPPER"_CACHE is",
+        "defined to be any value but zero (0) then the latest version found in",
+        "a search directory is cached under $XDG_CACHE_HOME/"PROGRAM_NAME" (or",
+        "$HOME/.cache/"PROGRAM_NAME"). A cached result is reused for as long as the",
+        "modification and change times of the search directory are unchanged.",
+        "",
+        "On a *nix system, the latest version can also be determined once, at",
+        "deployment time, by running this program with \"promote\" (without",
+        "quotes) as the first argument followed by a search path:",
+        "",
+        "  "PROGRAM_NAME" promote /app",
+        "",
+        "This atomically points a symbolic link named \""CURRENT_LINK_NAME"\" under the",
+        "search path to the latest version directory. As long as that link",
+        "points to an existing version directory, it is used instead of",
+        "scanning the search path.",
+        "",
+        "On a Linux system, running this program with \"daemon\" (without",
+        "quotes) as the first argument followed by a socket path starts a",
+        "resolver daemon that remembers the latest version of each search",
+        "path queried and watches it for changes. If the environment variable",
+        PROGRAM_NAME_UPPER"_DAEMON is defined to be the path of that socket then this",
+        "program first asks the daemon for the latest version of an absolute",
+        "search path and only scans the search path itself if the daemon",
+        "is absent or does not answer promptly.",
+        "",
+        "If the environment variable "PROGRAM_NAME_UPPER"_INDEX is also defined to be a",
+        "file path (e.g. under /dev/shm) when the daemon is started then the",
+        "daemon publishes the latest version of each search path it knows to",
+        "that file, keeping it current as search paths change. When the same",
+        "variable is defined for this program, it looks up the search path in",
+        "that file before asking the daemon.",
+        "",
         "This program is distributed under the terms and conditions of",
         "The MIT License. Run the program with \"license\" (without quotes) as",
         "the first argument to display the full text of the license.",
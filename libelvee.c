@@ -0,0 +1,583 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#if defined(_WIN64) || defined(_WIN32) && !defined(WINDOWS)
+#define WINDOWS
+#endif
+
+#include <string.h>
+#ifdef WINDOWS
+#include "include/win/dirent.h"
+#else
+#include <dirent.h>
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifndef WINDOWS
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <pthread.h>
+#endif
+
+#include "libelvee.h"
+
+#ifdef WINDOWS
+
+#define PATH_SEPARATOR_CHAR '\\'
+#define PATH_SEPARATOR      "\\"
+
+#else // *nix
+
+#define PATH_SEPARATOR_CHAR '/'
+#define PATH_SEPARATOR      "/"
+
+extern char **environ;
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+#endif
+
+#define DIM(x) (sizeof(x) / sizeof((x)[0]))
+
+// Parses "name" in a single pass as:
+//
+//     "v" MAJOR [ "." MINOR [ "." PATCH ] ] REST
+//
+// where MAJOR, MINOR and PATCH are decimal integers (that saturate at
+// UINT_MAX) and REST is stored as the suffix without validation. Absent
+// components are zero.
+
+int elvee_parse_version(const char *name, struct elvee_version *version)
+{
+    unsigned int *components[] = { &version->major, &version->minor, &version->patch };
+    const char *p = name;
+
+    if (*p++ != 'v' || *p < '0' || *p > '9')
+        return 0;
+
+    version->major = version->minor = version->patch = 0;
+
+    for (int i = 0; i < DIM(components); i++) {
+        if (i > 0) {
+            if (p[0] != '.' || p[1] < '0' || p[1] > '9')
+                break;
+            p++;
+        }
+        unsigned int n = 0;
+        for (; *p >= '0' && *p <= '9'; p++) {
+            unsigned int digit = *p - '0';
+            n = n > (UINT_MAX - digit) / 10 ? UINT_MAX : n * 10 + digit;
+        }
+        *components[i] = n;
+    }
+
+    version->suffix = p;
+    return 1;
+}
+
+// Suffixes only break ties between versions that both have one.
+
+int elvee_version_gt(const struct elvee_version *a, const struct elvee_version *b)
+{
+    if (a->major != b->major)
+        return a->major > b->major;
+    if (a->minor != b->minor)
+        return a->minor > b->minor;
+    if (a->patch != b->patch)
+        return a->patch > b->patch;
+    return *a->suffix && *b->suffix && strcmp(a->suffix, b->suffix) > 0;
+}
+
+unsigned int elvee_string_hash(const char *s, unsigned int hash)
+{
+    for (; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
+    }
+    return hash;
+}
+
+// Determines whether a directory entry is itself a directory. Some file
+// systems don't report entry types during a scan (DT_UNKNOWN) so the type is
+// then looked up relative to the open directory.
+
+static int is_dir_entry(DIR *d, struct dirent *dir)
+{
+#ifndef WINDOWS
+    if (dir->d_type == DT_UNKNOWN) {
+        struct stat st;
+        return !fstatat(dirfd(d), dir->d_name, &st, AT_SYMLINK_NOFOLLOW)
+            && S_ISDIR(st.st_mode);
+    }
+#endif
+    return dir->d_type == DT_DIR;
+}
+
+// Considers only sub-directories whose name conforms to the following
+// pattern:
+//
+//     "v" MAJOR [ "." MINOR [ "." PATCH ] ] [ "-" SUFFIX ]
+//
+// where MAJOR, MINOR and PATCH must be (when present) non-negative decimal
+// integers. The SUFFIX is any string of characters and compared verbatim.
+
+static int scan_latest(DIR *d, const char *search_path, char *lname, size_t size, struct elvee_scan *scan)
+{
+    if (scan && scan->opened) {
+        scan->opened(scan, search_path);
+    }
+
+    *lname = 0;
+    struct elvee_version lversion = { 0, 0, 0, lname };
+    struct dirent *dir;
+
+    while ((errno = 0, dir = readdir(d)) != NULL) {
+
+        if (scan) {
+            scan->entries++;
+        }
+
+        // Consider only directories that start with "v". The name is checked
+        // first since it's cheaper than the type when the latter has to be
+        // looked up.
+
+        struct elvee_version version;
+        int candidate = dir->d_name[0] == 'v'
+                     && is_dir_entry(d, dir)
+                     && elvee_parse_version(dir->d_name, &version)
+                     && (!*version.suffix || *version.suffix == '-'); // suffix must begin with a hyphen (-)
+
+        // Does this entry sort higher than the last we know? Then...
+
+        int upgrade = candidate && elvee_version_gt(&version, &lversion);
+
+        if (scan && scan->entry) {
+            scan->entry(scan, dir->d_name, dir->d_type, candidate ? &version : NULL, upgrade);
+        }
+
+        if (upgrade) {
+            size_t name_len = strlen(dir->d_name);
+            if (name_len >= size) {
+                *lname = 0;
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+            memcpy(lname, dir->d_name, name_len + 1); // ... upgrade!
+            lversion = version;
+            lversion.suffix = lname + (version.suffix - dir->d_name);
+        }
+    }
+
+    return errno ? -1 : 0;
+}
+
+int elvee_find_latest(const char *search_path, char *lname, size_t size, struct elvee_scan *scan)
+{
+    DIR *d = opendir(search_path);
+    if (!d) {
+        return -1;
+    }
+
+    int failed = scan_latest(d, search_path, lname, size, scan);
+    int error = errno;
+    closedir(d);
+    errno = error;
+    return failed;
+}
+
+int elvee_split_template(const char *tmpl, char *search_path, size_t size, const char **sub_path)
+{
+    static const char token[] = PATH_SEPARATOR "?" PATH_SEPARATOR;
+    const char *tt = strstr(tmpl, token);
+    if (!tt) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (tt - tmpl >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(search_path, tmpl, tt - tmpl);
+    search_path[tt - tmpl] = 0;
+    *sub_path = tt + DIM(token) - 1;
+    return 0;
+}
+
+// Formats the path of "sub_path" under version directory "lname" of
+// "search_path" into "buf" of "len" characters.
+
+static int format_path(const char *search_path, const char *lname, const char *sub_path, char *buf, size_t len)
+{
+    if (!*lname) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (snprintf(buf, len, "%s%s%s%s%s", search_path, PATH_SEPARATOR, lname, PATH_SEPARATOR, sub_path) >= len) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef WINDOWS
+
+// Same as elvee_read_current but for the current link at "link_path"
+// relative to the directory "dfd" (or AT_FDCWD).
+
+static int read_current_at(int dfd, const char *link_path, char *lname, size_t size)
+{
+    ssize_t len = size > 1 ? readlinkat(dfd, link_path, lname, size - 1) : -1;
+    if (len <= 0) {
+        if (size) {
+            *lname = 0;
+        }
+        return 0;
+    }
+    lname[len] = 0;
+
+    // The link must name a version directory right under the search
+    // directory, and one that still exists (the link is not dangling).
+
+    struct elvee_version version;
+    struct stat st;
+    if (strchr(lname, PATH_SEPARATOR_CHAR)
+        || !elvee_parse_version(lname, &version)
+        || (*version.suffix && *version.suffix != '-')
+        || fstatat(dfd, link_path, &st, 0) || !S_ISDIR(st.st_mode)) {
+        *lname = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+int elvee_read_current(const char *search_path, char *lname, size_t size)
+{
+    char link_path[PATH_MAX];
+    if (snprintf(link_path, DIM(link_path), "%s%s%s", search_path, PATH_SEPARATOR, ELVEE_CURRENT_LINK_NAME) >= DIM(link_path)) {
+        if (size) {
+            *lname = 0;
+        }
+        return 0;
+    }
+
+    return read_current_at(AT_FDCWD, link_path, lname, size);
+}
+
+// The directory of a level of a template, which stays open so that the
+// search directory of the next level can be opened relative to it rather
+// than looked up again from the root. "fd" is AT_FDCWD while none is open
+// and "d", once the directory has been scanned, owns "fd".
+
+struct level_dir {
+    int fd;
+    DIR *d;
+};
+
+static void level_dir_close(struct level_dir *dir)
+{
+    if (dir->d) {
+        closedir(dir->d);
+    }
+    else if (dir->fd != AT_FDCWD) {
+        close(dir->fd);
+    }
+    dir->fd = AT_FDCWD;
+    dir->d = NULL;
+}
+
+// Opens the directory at "path", relative to the one currently open in
+// "dir" (if any), in its place.
+
+static int level_dir_open(struct level_dir *dir, const char *path)
+{
+    int fd = openat(dir->fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int error = errno;
+    level_dir_close(dir);
+    if (fd < 0) {
+        errno = error;
+        return -1;
+    }
+    dir->fd = fd;
+    return 0;
+}
+
+// Finds the latest version in the search directory open in "dir", preferring
+// the current link.
+
+static int find_version_in(struct level_dir *dir, const char *search_path, char *lname, size_t size)
+{
+    if (read_current_at(dir->fd, ELVEE_CURRENT_LINK_NAME, lname, size)) {
+        return 0;
+    }
+    if (!(dir->d = fdopendir(dir->fd))) {
+        return -1;
+    }
+    return scan_latest(dir->d, search_path, lname, size, NULL);
+}
+
+#endif
+
+#ifndef WINDOWS
+static int resolve_cached(struct elvee_cache *cache, struct level_dir *dir, const char *dir_path,
+                          const char *search_path, const char *sub_path, char *buf, size_t len);
+#endif
+
+// Resolves the search path of each wildcard in turn, left to right, where
+// "sub_path" may have further wildcards (even as its very first segment),
+// consulting "cache" (*nix only) if not NULL. On *nix, the search directory
+// of each level is opened relative to that of the level before, for as long
+// as that one is open (it isn't after a cache hit).
+
+static int resolve_levels(struct elvee_cache *cache, const char *search_path, const char *sub_path,
+                          char *buf, size_t len)
+{
+    static const char token[] = PATH_SEPARATOR "?" PATH_SEPARATOR;
+    char next_search_path[PATH_MAX];
+    char next_sub_path[PATH_MAX];
+#ifndef WINDOWS
+    struct level_dir dir = { AT_FDCWD, NULL };
+    const char *dir_path = search_path; // search path relative to "dir"
+#endif
+    int failed;
+
+    for (;;) {
+        char lname[ELVEE_VERSION_NAME_SIZE];
+#ifndef WINDOWS
+        failed = cache
+               ? resolve_cached(cache, &dir, dir_path, search_path, sub_path, buf, len)
+               : level_dir_open(&dir, dir_path)
+                 || find_version_in(&dir, search_path, lname, DIM(lname))
+                 || format_path(search_path, lname, sub_path, buf, len);
+#else
+        failed = elvee_find_latest(search_path, lname, DIM(lname), NULL)
+              || format_path(search_path, lname, sub_path, buf, len);
+#endif
+        if (failed)
+            break;
+
+        // Look for the next wildcard from the separator that precedes the
+        // sub-path in the resolved path.
+
+        size_t buf_len = strlen(buf);
+        const char *tt = strstr(buf + buf_len - strlen(sub_path) - 1, token);
+        if (!tt)
+            break;
+
+        if (tt - buf >= DIM(next_search_path) || buf_len - (tt - buf) >= DIM(next_sub_path)) {
+            errno = ENAMETOOLONG;
+            failed = 1;
+            break;
+        }
+
+        // The next search path is the version directory followed by the
+        // sub-path up to the wildcard, so relative to the open directory it
+        // is whatever follows the current search path.
+
+        size_t version_offset = strlen(search_path) + 1;
+        memcpy(next_search_path, buf, tt - buf);
+        next_search_path[tt - buf] = 0;
+        strcpy(next_sub_path, tt + DIM(token) - 1);
+        search_path = next_search_path;
+        sub_path = next_sub_path;
+#ifndef WINDOWS
+        dir_path = dir.fd != AT_FDCWD ? next_search_path + version_offset : next_search_path;
+#endif
+    }
+
+#ifndef WINDOWS
+    int error = errno;
+    level_dir_close(&dir);
+    errno = error;
+#endif
+    return failed ? -1 : 0;
+}
+
+int elvee_resolve(const char *search_path, const char *sub_path, char *buf, size_t len)
+{
+    return resolve_levels(NULL, search_path, sub_path, buf, len);
+}
+
+#ifndef WINDOWS
+
+// The cache is a hash table of search paths, as given, with chained entries
+// behind a single lock that is only held to look up or store an entry and
+// never while scanning. Each entry records the identity and time stamps of
+// the search directory when it was scanned, so a search path that comes to
+// name another directory (e.g. a relative path after a change of the current
+// directory) simply misses.
+
+#define CACHE_BUCKETS 256
+
+struct elvee_cache_entry {
+    struct elvee_cache_entry *next;
+    unsigned int hash;
+    unsigned long long dev, ino;
+    long long mtime_sec, mtime_nsec;
+    long long ctime_sec, ctime_nsec;
+    char lname[ELVEE_VERSION_NAME_SIZE];
+    char path[];
+};
+
+struct elvee_cache {
+    pthread_mutex_t lock;
+    struct elvee_cache_entry *buckets[CACHE_BUCKETS];
+};
+
+static int cache_entry_matches(struct elvee_cache_entry *entry, struct stat *st)
+{
+    return entry->dev == st->st_dev
+        && entry->ino == st->st_ino
+        && entry->mtime_sec  == st->st_mtim.tv_sec
+        && entry->mtime_nsec == st->st_mtim.tv_nsec
+        && entry->ctime_sec  == st->st_ctim.tv_sec
+        && entry->ctime_nsec == st->st_ctim.tv_nsec;
+}
+
+struct elvee_cache *elvee_cache_create(void)
+{
+    struct elvee_cache *cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+    int err = pthread_mutex_init(&cache->lock, NULL);
+    if (err) {
+        free(cache);
+        errno = err;
+        return NULL;
+    }
+    return cache;
+}
+
+void elvee_cache_destroy(struct elvee_cache *cache)
+{
+    if (!cache)
+        return;
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        for (struct elvee_cache_entry *entry = cache->buckets[i], *next; entry; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// Resolves a level through "cache", where "dir_path" is "search_path"
+// relative to "dir". The directory is only opened, in place of "dir", to
+// scan it on a miss; on a hit, "dir" is closed.
+
+static int resolve_cached(struct elvee_cache *cache, struct level_dir *dir, const char *dir_path,
+                          const char *search_path, const char *sub_path, char *buf, size_t len)
+{
+    struct stat st;
+    if (fstatat(dir->fd, dir_path, &st, 0)) {
+        return -1;
+    }
+
+    unsigned int hash = elvee_string_hash(search_path, ELVEE_FNV_OFFSET_BASIS);
+    struct elvee_cache_entry **bucket = &cache->buckets[hash % CACHE_BUCKETS];
+    char lname[ELVEE_VERSION_NAME_SIZE] = { 0 };
+
+    pthread_mutex_lock(&cache->lock);
+    for (struct elvee_cache_entry *entry = *bucket; entry; entry = entry->next) {
+        if (entry->hash == hash && 0 == strcmp(entry->path, search_path)) {
+            if (cache_entry_matches(entry, &st)) {
+                strcpy(lname, entry->lname);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (*lname) {
+        level_dir_close(dir);
+        return format_path(search_path, lname, sub_path, buf, len);
+    }
+
+    if (level_dir_open(dir, dir_path) || find_version_in(dir, search_path, lname, DIM(lname))) {
+        return -1;
+    }
+
+    // Don't remember the answer until the time stamps of the directory have
+    // settled (see ELVEE_SETTLE_SECONDS). Nothing found is never remembered
+    // either.
+
+    time_t now = time(NULL);
+    if (*lname && now - st.st_mtim.tv_sec >= ELVEE_SETTLE_SECONDS
+               && now - st.st_ctim.tv_sec >= ELVEE_SETTLE_SECONDS) {
+        pthread_mutex_lock(&cache->lock);
+        struct elvee_cache_entry *entry = *bucket;
+        while (entry && (entry->hash != hash || strcmp(entry->path, search_path))) {
+            entry = entry->next;
+        }
+        if (!entry && (entry = malloc(sizeof(*entry) + strlen(search_path) + 1))) {
+            entry->hash = hash;
+            strcpy(entry->path, search_path);
+            entry->next = *bucket;
+            *bucket = entry;
+        }
+        if (entry) {
+            entry->dev = st.st_dev;
+            entry->ino = st.st_ino;
+            entry->mtime_sec  = st.st_mtim.tv_sec;
+            entry->mtime_nsec = st.st_mtim.tv_nsec;
+            entry->ctime_sec  = st.st_ctim.tv_sec;
+            entry->ctime_nsec = st.st_ctim.tv_nsec;
+            strcpy(entry->lname, lname);
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    return format_path(search_path, lname, sub_path, buf, len);
+}
+
+int elvee_resolve_cached(struct elvee_cache *cache, const char *search_path, const char *sub_path,
+                         char *buf, size_t len)
+{
+    return resolve_levels(cache, search_path, sub_path, buf, len);
+}
+
+int elvee_spawn(struct elvee_cache *cache, pid_t *pid,
+                const char *search_path, const char *sub_path,
+                char *const argv[], char *const envp[],
+                char *buf, size_t len)
+{
+    if (elvee_resolve_cached(cache, search_path, sub_path, buf, len)) {
+        return -1;
+    }
+    int err = posix_spawn(pid, buf, NULL, NULL, argv, envp ? envp : environ);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+#endif // WINDOWS
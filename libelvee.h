@@ -0,0 +1,153 @@
+/* Copyright (C) 2018 Atif Aziz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// libelvee finds (and launches) the latest version of a program the same way
+// as the elvee shim, but from within the calling process. It keeps no global
+// state: every function works on buffers owned by the caller and can be
+// called from any number of threads at once. The only state that can be
+// shared is a cache, which the caller creates and passes explicitly.
+//
+// Unless noted otherwise, functions return 0 on success or -1 with errno set
+// on failure, where ENOENT means that no version was found, EINVAL that a
+// template is malformed and ENAMETOOLONG that a buffer is too small.
+
+#ifndef LIBELVEE_H
+#define LIBELVEE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of a buffer large enough for any version directory name.
+
+#define ELVEE_VERSION_NAME_SIZE 256
+
+// Version parsed from a directory name where "suffix" points to whatever
+// follows the numeric components in the name (an empty string if nothing).
+
+struct elvee_version {
+    unsigned int major, minor, patch;
+    const char *suffix;
+};
+
+// Parses "name" as "v" MAJOR [ "." MINOR [ "." PATCH ] ] REST. Returns 1 on
+// success or 0 if "name" doesn't start with "v" followed by a digit.
+
+int elvee_parse_version(const char *name, struct elvee_version *version);
+
+// Determines whether version "a" sorts higher than version "b".
+
+int elvee_version_gt(const struct elvee_version *a, const struct elvee_version *b);
+
+// Hashes the string "s" into "hash" using FNV-1a. Start with
+// ELVEE_FNV_OFFSET_BASIS for "hash".
+
+#define ELVEE_FNV_OFFSET_BASIS 2166136261u
+
+unsigned int elvee_string_hash(const char *s, unsigned int hash);
+
+// Seconds after which the time stamps of a directory have settled. One
+// modified more recently could still be modified again without its time
+// stamps changing (depending on their granularity) so they can't yet be
+// trusted to validate a remembered answer.
+
+#define ELVEE_SETTLE_SECONDS 2
+
+// Optional observer of a scan for diagnostics. The callbacks, when not NULL,
+// are called once the directory has been opened and for each entry read,
+// where "version" is NULL unless the entry is a version directory and
+// "upgrade" tells whether it's the latest seen so far. "entries" counts the
+// entries read.
+
+struct elvee_scan {
+    void (*opened)(struct elvee_scan *scan, const char *search_path);
+    void (*entry)(struct elvee_scan *scan, const char *name, int type,
+                  const struct elvee_version *version, int upgrade);
+    unsigned long long entries;
+};
+
+// Scans "search_path" for the latest version directory and copies its name
+// to "lname" of "size" characters, or leaves it empty if none is found.
+// "scan" may be NULL.
+
+int elvee_find_latest(const char *search_path, char *lname, size_t size, struct elvee_scan *scan);
+
+// Splits a template of the form SEARCH_PATH "/?/" SUB_PATH (with "\?\" on
+// Windows), copying the search path to "search_path" of "size" characters
+// and pointing "sub_path" into "tmpl" at the sub-path.
+
+int elvee_split_template(const char *tmpl, char *search_path, size_t size, const char **sub_path);
+
+// Resolves the path of "sub_path" under the latest version directory of
+// "search_path" into "buf" of "len" characters. On *nix, a version published
+// with "elvee promote" wins over scanning. Any further "/?/" tokens in
+// "sub_path" are resolved in turn, left to right.
+
+int elvee_resolve(const char *search_path, const char *sub_path, char *buf, size_t len);
+
+#ifndef _WIN32
+
+// Name of the symbolic link, under a search directory, that "elvee promote"
+// points to the latest version directory.
+
+#define ELVEE_CURRENT_LINK_NAME "current"
+
+// Reads the version directory name that the current link under
+// "search_path" points to into "lname" of "size" characters. Returns 1 if
+// the link names an existing version directory; otherwise 0 with "lname"
+// left empty.
+
+int elvee_read_current(const char *search_path, char *lname, size_t size);
+
+// A thread-safe, in-process cache of the latest version per search
+// directory. An answer is reused for as long as the modification and change
+// times of the search directory are unchanged, which costs a single stat.
+
+struct elvee_cache;
+
+struct elvee_cache *elvee_cache_create(void);
+void elvee_cache_destroy(struct elvee_cache *cache);
+
+// Same as elvee_resolve but consults and updates "cache" (if not NULL).
+
+int elvee_resolve_cached(struct elvee_cache *cache, const char *search_path, const char *sub_path,
+                         char *buf, size_t len);
+
+// Resolves the program like elvee_resolve_cached, into "buf" of "len"
+// characters, and spawns it with posix_spawn, passing "argv" and "envp" (the
+// environment of the calling process if NULL). The process ID of the child
+// is stored in "pid"; waiting for it is up to the caller.
+
+int elvee_spawn(struct elvee_cache *cache, pid_t *pid,
+                const char *search_path, const char *sub_path,
+                char *const argv[], char *const envp[],
+                char *buf, size_t len);
+
+#endif // _WIN32
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBELVEE_H